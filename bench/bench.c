@@ -0,0 +1,426 @@
+// MIT License
+// Copyright (c) 2023 Lauri Lorenzo Fiestas
+// https://github.com/PrinssiFiestas/printf/blob/main/LICENSE.md
+
+// Not a test. Prints nanoseconds per call for some common workloads. Run with
+// `make bench`.
+
+#include <printf/printf.h>
+#include <printf/format_scanning.h>
+#include <printf/conversions.h>
+#include <printf/format.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 1000000
+#endif
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// Prevent compiler from optimizing results away
+static volatile unsigned sink;
+
+#define BENCH(NAME, ...) BENCH_N(NAME, BENCH_ITERATIONS, __VA_ARGS__)
+
+#define BENCH_N(NAME, ITERATIONS, ...) do \
+{ \
+    const unsigned _iterations = (ITERATIONS); \
+    const double start = now(); \
+    for (unsigned i = 0; i < _iterations; i++) \
+    { \
+        __VA_ARGS__; \
+    } \
+    const double ns = (now() - start) / _iterations; \
+    printf("%-40s %8.1f ns\n", NAME, ns); \
+} while (0)
+
+// Formats values over the whole exponent range, which use most rows of the
+// tables of Ryū printf. Rows are computed on the first pass if the library is
+// built with -DPF_LAZY_POW10_TABLES=1, so this runs before other benchmarks.
+static void bench_pow10_tables(void)
+{
+    char buf[512];
+    double values[601];
+    for (int i = 0; i < 601; i++)
+        values[i] = strtod((snprintf(buf, sizeof buf, "1.2345e%d", i - 300), buf), NULL);
+
+    #if defined(PF_LAZY_POW10_TABLES) && PF_LAZY_POW10_TABLES
+    puts("\nPOW10_SPLIT tables computed on first use, 0 KiB in binary");
+    #else
+    puts("\nPOW10_SPLIT tables embedded, 102 KiB in binary");
+    #endif
+    BENCH_N("first %.40e and %f of 1e-300..1e300", 1,
+        for (int j = 0; j < 601; j++)
+            sink += pf_snprintf(buf, sizeof buf, "%.40e%f", values[j], values[j]));
+    BENCH_N("again %.40e and %f of 1e-300..1e300", 1000,
+        for (int j = 0; j < 601; j++)
+            sink += pf_snprintf(buf, sizeof buf, "%.40e%f", values[j], values[j]));
+}
+
+static void bench_compiled_format(void)
+{
+    char buf[256];
+    const char* format = "[%s] request %u took %.3f ms, status %d\n";
+    PFCompiledFormat* compiled = pf_compile_format(format);
+
+    puts("\nLog line");
+    BENCH("snprintf()",
+        sink += snprintf(buf, sizeof buf, format, "GET", i, i * .001, 200));
+    BENCH("pf_snprintf()",
+        sink += pf_snprintf(buf, sizeof buf, format, "GET", i, i * .001, 200));
+    BENCH("pf_snprintf_compiled()",
+        sink += pf_snprintf_compiled(buf, sizeof buf, compiled,
+            "GET", i, i * .001, 200));
+
+    pf_format_cache_enable(true);
+    BENCH("pf_snprintf() with format cache",
+        sink += pf_snprintf(buf, sizeof buf, format, "GET", i, i * .001, 200));
+    pf_format_cache_enable(false);
+    BENCH("pf_format()",
+        sink += pf_format(buf, sizeof buf, "[", "GET", "] request ", i,
+            " took ", PF_SPEC("%.3f", i * .001), " ms, status ", 200, "\n"));
+
+    pf_free_compiled_format(compiled);
+}
+
+static void bench_long_literals(void)
+{
+    char buf[512];
+    const char* format =
+        "Connection from %s was closed by the remote host before the request "
+        "could be completed. Retrying with exponential backoff, attempt %d.\n";
+
+    puts("\nLong template with few conversions");
+    BENCH("snprintf()",
+        sink += snprintf(buf, sizeof buf, format, "10.0.0.1", i));
+    BENCH("pf_snprintf()",
+        sink += pf_snprintf(buf, sizeof buf, format, "10.0.0.1", i));
+}
+
+static void bench_file_output(void)
+{
+    FILE* f = fopen("/dev/null", "w");
+    if (f == NULL)
+        return;
+    const char* format = "[%s] request %u took %.3f ms, status %d\n";
+
+    puts("\nLog line to fully buffered file");
+    BENCH("fprintf()",
+        sink += fprintf(f, format, "GET", i, i * .001, 200));
+    BENCH("pf_fprintf()",
+        sink += pf_fprintf(f, format, "GET", i, i * .001, 200));
+
+    fclose(f);
+}
+
+// The old way of allocating: measure first, then format again.
+static char* two_pass_asprintf(const char* format, int width, unsigned i)
+{
+    const int length = pf_snprintf(NULL, 0, format, i, i * .001, width, "x");
+    char* result = malloc(length + 1);
+    pf_snprintf(result, length + 1, format, i, i * .001, width, "x");
+    return result;
+}
+
+static void bench_allocating(void)
+{
+    const char* format = "request %u took %.3f ms %*s";
+    const struct { const char* name; int width; unsigned iterations; } sizes[] = {
+        { "100 B",   100 - 30,  BENCH_ITERATIONS        },
+        { "4 KiB",   4096 - 30, BENCH_ITERATIONS / 10   },
+        { "1 MiB",   1 << 20,   BENCH_ITERATIONS / 1000 },
+    };
+
+    for (size_t j = 0; j < sizeof sizes / sizeof sizes[0]; j++)
+    {
+        printf("\nAllocating %s\n", sizes[j].name);
+        const int w = sizes[j].width;
+        char* p;
+        BENCH_N("two-pass pf_snprintf() + malloc()", sizes[j].iterations,
+            p = two_pass_asprintf(format, w, i); sink += p[0]; free(p));
+        BENCH_N("pf_asprintf()", sizes[j].iterations,
+            pf_asprintf(&p, format, i, i * .001, w, "x"); sink += p[0]; free(p));
+        BENCH_N("pf_asprintf_shrink()", sizes[j].iterations,
+            pf_asprintf_shrink(&p, format, i, i * .001, w, "x");
+            sink += p[0]; free(p));
+    }
+}
+
+static void bench_formatted_length(void)
+{
+    const char* format = "[%s] id %llu took %.3f ms, %e bytes/s, status %d\n";
+
+    puts("\nMeasuring output length");
+    BENCH("pf_snprintf(NULL, 0, ...)",
+        sink += pf_snprintf(NULL, 0, format,
+            "GET", 1234567890123ull + i, i * .001, i * 1e6, 200));
+    BENCH("pf_formatted_length()",
+        sink += pf_formatted_length(format,
+            "GET", 1234567890123ull + i, i * .001, i * 1e6, 200));
+}
+
+static void bench_utoa(void)
+{
+    char buf[32];
+    char name[64];
+
+    puts("\nInteger conversion by digit count");
+    uint64_t pow10 = 1;
+    for (unsigned digits = 1; digits <= 20; digits++)
+    {
+        // Vary low digits so the loop can't be folded to a constant
+        const uint64_t x = digits == 20 ? UINT64_MAX : 10 * pow10 - 1;
+        const unsigned m = pow10 < 1000 ? pow10 : 1000;
+        snprintf(name, sizeof name, "snprintf(\"%%ju\") %2u digits", digits);
+        BENCH(name,
+            sink += snprintf(buf, sizeof buf, "%ju", (uintmax_t)(x - i % m)));
+        snprintf(name, sizeof name, "pf_utoa() %2u digits", digits);
+        BENCH(name,
+            sink += pf_utoa(sizeof buf, buf, x - i % m));
+        pow10 *= digits < 19 ? 10 : 1;
+    }
+}
+
+// Same values in order of digit count and shuffled. Digit counts that branch on
+// the value are fast on the former only, as the branches are predictable there.
+static void bench_digit_lengths(void)
+{
+    enum { COUNT = 4096 };
+    static uint64_t sorted[COUNT];
+    static uint64_t shuffled[COUNT];
+    static double shuffled_doubles[COUNT];
+    char buf[64];
+
+    uint64_t pow10 = 1;
+    for (unsigned i = 0; i < COUNT; i++)
+    {
+        // Lengths 1 to 20 in blocks
+        const unsigned digits = 1 + i * 20 / COUNT;
+        if (i == 0 || digits != 1 + (i - 1) * 20 / COUNT)
+            pow10 = digits == 1 ? 1 : pow10 * 10;
+        sorted[i] = pow10 + (uint64_t)rand() % (digits < 20 ? 9 * pow10 : 1000);
+    }
+    memcpy(shuffled, sorted, sizeof shuffled);
+    for (unsigned i = COUNT - 1; i > 0; i--)
+    {
+        const unsigned j = (unsigned)rand() % (i + 1);
+        const uint64_t t = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = t;
+    }
+    for (unsigned i = 0; i < COUNT; i++)
+        shuffled_doubles[i] = (double)(shuffled[i] >> (shuffled[i] % 12)) * 1e-3;
+
+    puts("\nRandom digit counts");
+    BENCH("pf_formatted_length(\"%ju\") sorted",
+        sink += pf_formatted_length("%ju", (uintmax_t)sorted[i % COUNT]));
+    BENCH("pf_formatted_length(\"%ju\") shuffled",
+        sink += pf_formatted_length("%ju", (uintmax_t)shuffled[i % COUNT]));
+    BENCH("pf_utoa() sorted",
+        sink += pf_utoa(sizeof buf, buf, sorted[i % COUNT]));
+    BENCH("pf_utoa() shuffled",
+        sink += pf_utoa(sizeof buf, buf, shuffled[i % COUNT]));
+    BENCH("pf_dtoa_shortest() shuffled",
+        sink += pf_dtoa_shortest(sizeof buf, buf, shuffled_doubles[i % COUNT]));
+    BENCH("pf_snprintf(\"%.3e\") shuffled",
+        sink += pf_snprintf(buf, sizeof buf, "%.3e", shuffled_doubles[i % COUNT]));
+}
+
+static void bench_hex(void)
+{
+    char buf[64];
+    const char* format = "span %016lx parent %lx mode %o";
+
+    puts("\nHexadecimal and octal");
+    BENCH("snprintf()",
+        sink += snprintf(buf, sizeof buf, format,
+            0x9e3779b97f4a7c15ul * i, 0xdeadbeeful + i, 0644u + i % 8));
+    BENCH("pf_snprintf()",
+        sink += pf_snprintf(buf, sizeof buf, format,
+            0x9e3779b97f4a7c15ul * i, 0xdeadbeeful + i, 0644u + i % 8));
+}
+
+static void bench_shortest(void)
+{
+    char buf[64];
+    const char* shortest = "%r"; // not a literal to avoid -Wformat
+
+    puts("\nRound trip doubles");
+    BENCH("snprintf(\"%.17g\")",
+        sink += snprintf(buf, sizeof buf, "%.17g", i * 1.1));
+    BENCH("pf_snprintf(\"%.17g\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.17g", i * 1.1));
+    BENCH("pf_snprintf(\"%r\")",
+        sink += pf_snprintf(buf, sizeof buf, shortest, i * 1.1));
+    BENCH("pf_dtoa_shortest()",
+        sink += pf_dtoa_shortest(sizeof buf, buf, i * 1.1));
+}
+
+// Prices and measurements, where digits of the fixed notation are few.
+static void bench_short_precision(void)
+{
+    char buf[64];
+
+    puts("\nShort precision doubles");
+    BENCH("snprintf(\"%.2f\")",
+        sink += snprintf(buf, sizeof buf, "%.2f", i * .01));
+    BENCH("pf_snprintf(\"%.2f\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.2f", i * .01));
+    BENCH("snprintf(\"%g\")",
+        sink += snprintf(buf, sizeof buf, "%g", i * .01));
+    BENCH("pf_snprintf(\"%g\")",
+        sink += pf_snprintf(buf, sizeof buf, "%g", i * .01));
+}
+
+// Counts and sizes stored as doubles.
+static void bench_integral_doubles(void)
+{
+    char buf[64];
+
+    puts("\nIntegral doubles");
+    BENCH("snprintf(\"%.2f\")",
+        sink += snprintf(buf, sizeof buf, "%.2f", (double)(i * 7919)));
+    BENCH("pf_snprintf(\"%.2f\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.2f", (double)(i * 7919)));
+    BENCH("pf_snprintf(\"%.0f\") of 2^53 + 2i",
+        sink += pf_snprintf(buf, sizeof buf, "%.0f", 9007199254740992. + 2. * i));
+    BENCH("pf_snprintf(\"%.20e\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.20e", (double)(i * 7919)));
+}
+
+// Precision up to 17 takes the 128-bit fast path with moderate exponents.
+static void bench_precisions(void)
+{
+    char buf[64];
+    char name[64];
+    const unsigned precisions[] = { 0, 3, 6, 9, 12, 15, 17, 18 };
+
+    puts("\nDoubles per precision");
+    for (size_t j = 0; j < sizeof precisions / sizeof precisions[0]; j++)
+    {
+        const int p = precisions[j];
+        snprintf(name, sizeof name, "pf_snprintf(\"%%.%df\")", p);
+        BENCH(name, sink += pf_snprintf(buf, sizeof buf, "%.*f", p, i * .37));
+        snprintf(name, sizeof name, "pf_snprintf(\"%%.%de\")", p);
+        BENCH(name, sink += pf_snprintf(buf, sizeof buf, "%.*e", p, i * .37));
+    }
+}
+
+// Sensor-like values, float converted to double for the double path.
+static void bench_floats(void)
+{
+    char buf[64];
+    const char* fixed    = "%.3hf"; // not literals to avoid -Wformat
+    const char* exp      = "%.6he";
+    const char* shortest = "%r";
+    const char* shortest_float = "%hr";
+
+    puts("\nFloats");
+    BENCH("snprintf(\"%.3f\")",
+        sink += snprintf(buf, sizeof buf, "%.3f", (double)(i * .37f)));
+    BENCH("pf_snprintf(\"%.3f\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.3f", (double)(i * .37f)));
+    BENCH("pf_snprintf(\"%.3hf\")",
+        sink += pf_snprintf(buf, sizeof buf, fixed, (double)(i * .37f)));
+    BENCH("pf_snprintf(\"%.6e\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.6e", (double)(i * .37f)));
+    BENCH("pf_snprintf(\"%.6he\")",
+        sink += pf_snprintf(buf, sizeof buf, exp, (double)(i * .37f)));
+    BENCH("pf_snprintf(\"%r\")",
+        sink += pf_snprintf(buf, sizeof buf, shortest, (double)(i * .37f)));
+    BENCH("pf_snprintf(\"%hr\")",
+        sink += pf_snprintf(buf, sizeof buf, shortest_float, (double)(i * .37f)));
+    BENCH("snprintf(\"%a\")",
+        sink += snprintf(buf, sizeof buf, "%a", (double)(i * .37f)));
+    BENCH("pf_snprintf(\"%a\")",
+        sink += pf_snprintf(buf, sizeof buf, "%a", (double)(i * .37f)));
+    BENCH("pf_atoa()",
+        sink += pf_atoa(sizeof buf, buf, (double)(i * .37f)));
+    BENCH("snprintf(\"%.3Lf\")",
+        sink += snprintf(buf, sizeof buf, "%.3Lf", i * .37L));
+    BENCH("pf_snprintf(\"%.3Lf\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.3Lf", i * .37L));
+    BENCH("snprintf(\"%.6Le\")",
+        sink += snprintf(buf, sizeof buf, "%.6Le", i * .37L));
+    BENCH("pf_snprintf(\"%.6Le\")",
+        sink += pf_snprintf(buf, sizeof buf, "%.6Le", i * .37L));
+}
+
+#define ARRAY_LENGTH (1 << 20)
+
+// Prints output bytes per nanosecond of a single call converting a whole array.
+#define BENCH_ARRAY(NAME, ...) do \
+{ \
+    const double start = now(); \
+    const size_t _bytes = (__VA_ARGS__); \
+    printf("%-40s %8.2f GB/s\n", NAME, _bytes / (now() - start)); \
+    sink += _bytes; \
+} while (0)
+
+static size_t per_element_snprintf(
+    char* buf, size_t n, const char* format, const uint64_t* u, const double* f)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < ARRAY_LENGTH; i++)
+        length += u != NULL ?
+            pf_snprintf(buf + length, n - length, format, u[i]) :
+            pf_snprintf(buf + length, n - length, format, f[i]);
+    return length;
+}
+
+static void bench_arrays(void)
+{
+    uint64_t* u = malloc(ARRAY_LENGTH * sizeof u[0]);
+    double*   f = malloc(ARRAY_LENGTH * sizeof f[0]);
+    const size_t n = ARRAY_LENGTH * 32;
+    char* buf = malloc(n);
+    memset(buf, 0, n); // don't measure page faults
+    for (size_t i = 0; i < ARRAY_LENGTH; i++)
+    {
+        u[i] = 1700000000000000000u + i * 7919; // nanosecond timestamps
+        f[i] = i * .001;
+    }
+    const PFFormatSpecifier fixed3 = pf_scan_format_string("%.3f", NULL);
+
+    puts("\nArrays of 1M elements");
+    BENCH_ARRAY("pf_snprintf() per uint64_t",
+        per_element_snprintf(buf, n, "%llu,", u, NULL));
+    BENCH_ARRAY("pf_utoa_array()",
+        pf_utoa_array(buf, n, u, ARRAY_LENGTH, ",", NULL));
+    BENCH_ARRAY("pf_snprintf() per double",
+        per_element_snprintf(buf, n, "%.3f,", NULL, f));
+    BENCH_ARRAY("pf_ftoa_array()",
+        pf_ftoa_array(buf, n, f, ARRAY_LENGTH, ",", &fixed3));
+
+    free(u);
+    free(f);
+    free(buf);
+}
+
+int main(void)
+{
+    bench_pow10_tables();
+    bench_compiled_format();
+    bench_long_literals();
+    bench_file_output();
+    bench_allocating();
+    bench_formatted_length();
+    bench_utoa();
+    bench_digit_lengths();
+    bench_hex();
+    bench_shortest();
+    bench_short_precision();
+    bench_precisions();
+    bench_integral_doubles();
+    bench_floats();
+    bench_arrays();
+}
@@ -0,0 +1,45 @@
+// MIT License
+// Copyright (c) 2023 Lauri Lorenzo Fiestas
+// https://github.com/PrinssiFiestas/printf/blob/main/LICENSE.md
+
+#ifndef ALLOCATOR_H_INCLUDED
+#define ALLOCATOR_H_INCLUDED 1
+
+#include <stddef.h>
+
+// Memory for allocating functions. Sizes of old allocations are passed back so
+// allocators don't need to store them. All functions get context as their
+// first argument.
+typedef struct PFAllocator
+{
+    void* (*alloc)  (void* context, size_t size);
+    void* (*realloc)(void* context, void* ptr, size_t old_size, size_t new_size);
+    void  (*free)   (void* context, void* ptr, size_t size);
+    void* context;
+} PFAllocator;
+
+// Uses malloc(), realloc(), and free().
+extern const PFAllocator pf_heap_allocator;
+
+// Bump allocator using memory provided by the user. Allocations fail when it
+// runs out of memory. Freeing does nothing unless it is the last allocation,
+// which can also be resized in place. Initialize with
+// PFArena arena = { memory, sizeof memory };
+typedef struct PFArena
+{
+    void* memory;
+    size_t capacity;
+    size_t position; // end of last allocation
+    size_t last;     // start of last allocation
+} PFArena;
+
+PFAllocator pf_arena_allocator(PFArena*);
+
+// Frees all allocations at once.
+static inline void pf_arena_reset(PFArena* arena)
+{
+    arena->position = 0;
+    arena->last     = 0;
+}
+
+#endif // ALLOCATOR_H_INCLUDED
@@ -6,6 +6,7 @@
 #define CONVERSIONS_H_INCLUDED 1
 
 #include <printf/format_scanning.h>
+#include <printf/printf.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -16,6 +17,10 @@ unsigned pf_otoa(size_t n, char* buf, uintmax_t x);
 unsigned pf_xtoa(size_t n, char* buf, uintmax_t x);
 unsigned pf_Xtoa(size_t n, char* buf, uintmax_t x);
 unsigned pf_itoa(size_t n, char* buf, intmax_t x);
+#if defined(__SIZEOF_INT128__)
+unsigned pf_u128toa(size_t n, char* buf, unsigned __int128 x);
+unsigned pf_i128toa(size_t n, char* buf, __int128 x);
+#endif
 unsigned pf_ftoa(size_t n, char* buf, double x);
 unsigned pf_Ftoa(size_t n, char* buf, double x);
 unsigned pf_etoa(size_t n, char* buf, double x);
@@ -23,6 +28,66 @@ unsigned pf_Etoa(size_t n, char* buf, double x);
 unsigned pf_gtoa(size_t n, char* buf, double x);
 unsigned pf_Gtoa(size_t n, char* buf, double x);
 
+// Exact hexadecimal representation like "0x1.8p+1". Same as "%a" in pf_printf()
+// family of functions, or "%A" for uppercase. Cheapest exact conversion.
+unsigned pf_atoa(size_t n, char* buf, double x);
+unsigned pf_Atoa(size_t n, char* buf, double x);
+
+// Shortest representation that converts back to exactly x. Notation is like
+// "%g" with precision of 17, but only significant digits are written. Same as
+// "%r" in pf_printf() family of functions, or "%R" for uppercase.
+unsigned pf_dtoa_shortest(size_t n, char* buf, double x);
+
 unsigned pf_strfromd(char* buf, size_t n, PFFormatSpecifier fmt, double f);
 
+// Same as pf_strfromd() with f converted to double, but formatted with single
+// precision arithmetic, except that "%r" gives the shortest representation that
+// converts back to exactly f as float. Same as "%hf", "%he", "%hr" etc. in
+// pf_printf() family of functions.
+unsigned pf_strfromf(char* buf, size_t n, PFFormatSpecifier fmt, float f);
+
+// Same as pf_strfromd(), but for long double, and exact with any precision for
+// x87 extended precision and IEEE binary128. "%r" writes DECIMAL_DIG
+// significant digits, which converts back to f, but is not always the shortest.
+// Same as "%Lf", "%Le", "%Lr" etc. in pf_printf() family of functions.
+unsigned pf_strfromld(
+    char* buf, size_t n, PFFormatSpecifier fmt, long double f);
+
+// Write length elements of array separated by separator as if by pf_snprintf()
+// with format specifier fmt for each element, but without scanning or reading
+// arguments. fmt is optional, by default "%u", "%d", or "%f" is used. If the
+// conversion of fmt is not one of "ouxX", "di", or "fFeEgGrRaA" respectively, the
+// default conversion is used with flags, field width, and precision of fmt.
+// Asterisks in fmt are ignored. Return the length of the whole output like
+// pf_snprintf(). Output is null-terminated if n > 0.
+
+size_t pf_utoa_array(
+    char* buf, size_t n,
+    const uint64_t array[], size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt);
+size_t pf_itoa_array(
+    char* buf, size_t n,
+    const int64_t array[], size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt);
+size_t pf_ftoa_array(
+    char* buf, size_t n,
+    const double array[], size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt);
+
+// Same as above, but output is streamed to sink like with pf_sinkprintf() and
+// not null-terminated.
+
+size_t pf_utoa_array_sink(
+    PFSink sink[static 1],
+    const uint64_t array[], size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt);
+size_t pf_itoa_array_sink(
+    PFSink sink[static 1],
+    const int64_t array[], size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt);
+size_t pf_ftoa_array_sink(
+    PFSink sink[static 1],
+    const double array[], size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt);
+
 #endif // CONVERSIONS_H_INCLUDED
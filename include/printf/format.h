@@ -0,0 +1,238 @@
+// MIT License
+// Copyright (c) 2023 Lauri Lorenzo Fiestas
+// https://github.com/PrinssiFiestas/printf/blob/main/LICENSE.md
+
+#ifndef FORMAT_H_INCLUDED
+#define FORMAT_H_INCLUDED 1
+
+#include <printf/format_scanning.h>
+#include <gpc/overload.h>
+#include <stdint.h>
+
+// Type-safe formatting without format strings. Arguments are written in order
+// by calling a writer selected by their type at compile time, so no format
+// string gets scanned and no argument is read with va_arg(). Strings are
+// written as they are. Other types use the same conversion as gp_print():
+// "%i" for signed integers, "%u" for unsigned, "%g" for doubles, "%hg" for
+// floats, "%Lg" for long doubles, "%c" for char, and "%p" for any other
+// pointer. PF_SPEC() gives an argument an explicit format specifier, which gets
+// scanned only on the first call at each call site. Returns the length of the
+// formatted string like pf_snprintf(). C11 and GNU C statement expressions are
+// required. Example:
+/*
+    char buf[128];
+    int length = pf_format(buf, sizeof buf,
+        "request ", id, " took ", PF_SPEC("%.3f", ms), " ms");
+*/
+#define /* int */ pf_format(/* char* buf, size_t n, */...) \
+    PF_FORMAT(__VA_ARGS__)
+
+// The specifier should contain a single conversion matching the type of VALUE.
+// Asterisks are not supported. If the conversion does not match the type, the
+// default conversion for the type will be used with flags, field width, and
+// precision of the specifier. Signed integers can also be written with 'o',
+// 'u', 'x', and 'X', which convert them to uintmax_t.
+#define /* PFArg */ PF_SPEC(/* const char* specifier, T value */ SPEC, VALUE) \
+    pf_arg_spec(PF_ARG(VALUE), ({                                           \
+        static PFStaticSpec _pf_static_spec;                                 \
+        pf_static_spec(&_pf_static_spec, SPEC);                              \
+    }))
+
+// ----------------------------------------------------------------------------
+//
+//          END OF API REFERENCE
+//
+//          Code below is for internal usage and may change without notice.
+//
+// ----------------------------------------------------------------------------
+
+typedef union PFArgValue
+{
+    intmax_t    i; // 'd', 'i'
+    uintmax_t   u; // 'c', 'o', 'x', 'X', 'u', 'p'
+    double      f; // 'f', 'F', 'e', 'E', 'g', 'G', 'r', 'R', 'a', 'A'
+    long double ld; // same with length modifier 'L'
+    const char* s; // 's'
+    #if defined(__SIZEOF_INT128__)
+    __int128          i128; // 'd', 'i' with length modifier 'w'
+    unsigned __int128 u128; // 'o', 'x', 'X', 'u' with length modifier 'w'
+    #endif
+} PFArgValue;
+
+typedef struct PFArg
+{
+    PFFormatSpecifier fmt;
+    PFArgValue value;
+} PFArg;
+
+typedef struct PFWriter
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+} PFWriter;
+
+void pf_write_arg    (PFWriter*, PFArg);
+void pf_write_int    (PFWriter*, intmax_t);
+void pf_write_uint   (PFWriter*, uintmax_t);
+void pf_write_double (PFWriter*, double);
+void pf_write_float  (PFWriter*, float);
+void pf_write_long_double(PFWriter*, long double);
+void pf_write_char   (PFWriter*, char);
+void pf_write_string (PFWriter*, const char*);
+void pf_write_pointer(PFWriter*, const void*);
+int  pf_writer_end   (PFWriter*);
+
+typedef struct PFStaticSpec
+{
+    PFFormatSpecifier fmt;
+    unsigned state;
+} PFStaticSpec;
+
+PFFormatSpecifier pf_static_spec_scan(PFStaticSpec*, const char*);
+
+static inline PFFormatSpecifier
+pf_static_spec(PFStaticSpec* static_spec, const char* spec)
+{
+    if (__atomic_load_n(&static_spec->state, __ATOMIC_ACQUIRE) == 2)
+        return static_spec->fmt;
+    return pf_static_spec_scan(static_spec, spec);
+}
+
+static inline PFArg pf_arg_spec(PFArg arg, const PFFormatSpecifier fmt)
+{
+    const unsigned char conversion = arg.fmt.conversion_format;
+    const unsigned char length_modifier = arg.fmt.length_modifier;
+    arg.fmt = fmt;
+    switch (fmt.conversion_format)
+    {
+        case 'd': case 'i':
+            if (conversion == 'i')
+                return arg;
+            break;
+
+        case 'o': case 'x': case 'X': case 'u':
+            if (conversion == 'i' || conversion == 'u')
+                return arg;
+            break;
+
+        case 'f': case 'F':
+        case 'e': case 'E':
+        case 'g': case 'G':
+        case 'r': case 'R':
+        case 'a': case 'A':
+            if (conversion == 'g') {
+                // float or long double, which is not converted
+                if (length_modifier == 'h' || length_modifier == 'L')
+                    arg.fmt.length_modifier = length_modifier;
+                else if (arg.fmt.length_modifier == 'L')
+                    arg.fmt.length_modifier = 0;
+                return arg;
+            }
+            break;
+
+        default:
+            if (conversion == fmt.conversion_format)
+                return arg;
+    }
+    arg.fmt.conversion_format = conversion;
+    arg.fmt.length_modifier = length_modifier;
+    return arg;
+}
+
+static inline PFArg pf_arg_int(const intmax_t i)
+{
+    return (PFArg){ .fmt.conversion_format = 'i', .value.i = i };
+}
+
+static inline PFArg pf_arg_uint(const uintmax_t u)
+{
+    return (PFArg){ .fmt.conversion_format = 'u', .value.u = u };
+}
+
+static inline PFArg pf_arg_double(const double f)
+{
+    return (PFArg){ .fmt.conversion_format = 'g', .value.f = f };
+}
+
+static inline PFArg pf_arg_float(const float f)
+{
+    return (PFArg){
+        .fmt.conversion_format = 'g', .fmt.length_modifier = 'h',
+        .value.f = (double)f };
+}
+
+static inline PFArg pf_arg_long_double(const long double f)
+{
+    return (PFArg){
+        .fmt.conversion_format = 'g', .fmt.length_modifier = 'L',
+        .value.ld = f };
+}
+
+static inline PFArg pf_arg_char(const char c)
+{
+    return (PFArg){ .fmt.conversion_format = 'c', .value.u = c };
+}
+
+static inline PFArg pf_arg_string(const char* s)
+{
+    return (PFArg){ .fmt.conversion_format = 's', .value.s = s };
+}
+
+static inline PFArg pf_arg_pointer(const void* p)
+{
+    return (PFArg){ .fmt.conversion_format = 'p', .value.u = (uintptr_t)p };
+}
+
+#define PF_ARG(VALUE)                       \
+_Generic(VALUE,                             \
+    bool:               pf_arg_int,         \
+    signed char:        pf_arg_int,         \
+    short:              pf_arg_int,         \
+    int:                pf_arg_int,         \
+    long:               pf_arg_int,         \
+    long long:          pf_arg_int,         \
+    unsigned char:      pf_arg_uint,        \
+    unsigned short:     pf_arg_uint,        \
+    unsigned int:       pf_arg_uint,        \
+    unsigned long:      pf_arg_uint,        \
+    unsigned long long: pf_arg_uint,        \
+    float:              pf_arg_float,       \
+    double:             pf_arg_double,      \
+    long double:        pf_arg_long_double, \
+    char:               pf_arg_char,        \
+    char*:              pf_arg_string,      \
+    const char*:        pf_arg_string,      \
+    default:            pf_arg_pointer)(VALUE)
+
+#define PF_WRITE(VALUE)                     \
+_Generic(VALUE,                             \
+    PFArg:              pf_write_arg,       \
+    bool:               pf_write_int,       \
+    signed char:        pf_write_int,       \
+    short:              pf_write_int,       \
+    int:                pf_write_int,       \
+    long:               pf_write_int,       \
+    long long:          pf_write_int,       \
+    unsigned char:      pf_write_uint,      \
+    unsigned short:     pf_write_uint,      \
+    unsigned int:       pf_write_uint,      \
+    unsigned long:      pf_write_uint,      \
+    unsigned long long: pf_write_uint,      \
+    float:              pf_write_float,     \
+    double:             pf_write_double,    \
+    long double:        pf_write_long_double, \
+    char:               pf_write_char,      \
+    char*:              pf_write_string,    \
+    const char*:        pf_write_string,    \
+    default:            pf_write_pointer)(&_pf_writer, VALUE)
+
+#define PF_SEMICOLON(...) ;
+
+#define PF_FORMAT(BUF, N, ...) ({                           \
+    PFWriter _pf_writer = { (BUF), 0, (N) };                \
+    GP_PROCESS_ALL_ARGS(PF_WRITE, PF_SEMICOLON, __VA_ARGS__); \
+    pf_writer_end(&_pf_writer);                             \
+})
+
+#endif // FORMAT_H_INCLUDED
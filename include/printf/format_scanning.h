@@ -6,11 +6,13 @@
 #define FORMAT_SCANNING_H_INCLUDED 1
 
 #include <stddef.h>
+#include <printf/allocator.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
 
 // Return type of scan_format_string(). Can also be filled manually to be used
-// with pf_strfromd().
+// with pf_strfromd() or pf_strfromf().
 typedef struct PFFormatSpecifier
 {
     // Pointer to the first occurrence of '%' in fmt_string passed to
@@ -45,8 +47,11 @@ typedef struct PFFormatSpecifier
         } option;
     } precision;
 
-    unsigned char length_modifier;   // any of "hljztL" or 2*'h' or 2*'l'
-    unsigned char conversion_format; // any of "csdioxXufFeEgGp". 'n' not supported.
+    // any of "hljztL" or 2*'h' or 2*'l', or 'w' for 128-bit integers given
+    // with "w128" or "I128". 'h' with floating point conversions means float.
+    // 'L' means long double.
+    unsigned char length_modifier;
+    unsigned char conversion_format; // any of "csdioxXufFeEgGrRaAp". 'n' not supported.
 } PFFormatSpecifier;
 
 // Portability wrapper.
@@ -61,4 +66,55 @@ pf_scan_format_string(
     const char fmt_string[static 1], // should be null-terminated
     pf_va_list* optional_asterisks);
 
+// Return type of pf_compile_format(). Stores all format specifiers of a format
+// string so it can be printed with pf_*printf_compiled() functions without
+// scanning the format string again. Literal text between specifiers is not
+// copied but pointed to by the specifiers, so the format string must outlive
+// the compiled format. Asterisks are left unresolved and read from the
+// argument list on every print.
+typedef struct PFCompiledFormat
+{
+    const char* format;
+    size_t tail_length; // length of literal text after the last specifier
+    size_t length;      // number of specifiers
+    PFFormatSpecifier specifiers[];
+} PFCompiledFormat;
+
+// Allocates. Returns NULL if allocation fails. Free with
+// pf_free_compiled_format().
+PFCompiledFormat*
+pf_compile_format(
+    const char fmt_string[static 1]); // should be null-terminated
+
+void pf_free_compiled_format(PFCompiledFormat*);
+
+// Same as above, but use allocator. Free with the same allocator.
+PFCompiledFormat*
+pf_compile_format_with(
+    const PFAllocator allocator[static 1],
+    const char fmt_string[static 1]);
+
+void pf_free_compiled_format_with(
+    const PFAllocator allocator[static 1], PFCompiledFormat*);
+
+// Process-wide cache of scanned format strings keyed by the address of the
+// format string. When enabled, pf_vsnprintf() and everything built on it looks
+// up the format specifiers from the cache before scanning the format string.
+// Only enable if format strings are never modified or reused at the same
+// address with different contents, e.g. if they are all string literals.
+// Disabled by default. Memory usage is fixed. Lookups never lock.
+void pf_format_cache_enable(bool enable);
+
+typedef struct PFFormatCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} PFFormatCacheStats;
+
+PFFormatCacheStats pf_format_cache_stats(void);
+
+// Formats with more specifiers than this are not cached.
+#define PF_FORMAT_CACHE_MAX_SPECIFIERS 8
+
 #endif // FORMAT_SCANNING_H_INCLUDED
@@ -8,6 +8,14 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+// In addition to standard conversions, "%r" and "%R" write the shortest
+// representation of a double that converts back to the same value. See
+// pf_dtoa_shortest() in conversions.h. Length modifier 'h' with floating point
+// conversions, like "%hf" or "%hr", formats the argument as float, see
+// pf_strfromf(). Compilers don't recognize these when checking format strings,
+// so they may trigger -Wformat warnings. Length modifier 'L' formats long
+// double, see pf_strfromld().
+
 int pf_vprintf(
     const char fmt[restrict static 1], va_list args);
 int pf_vfprintf(
@@ -32,4 +40,141 @@ __attribute__((format (printf, 3, 4)))
 int pf_snprintf(
     char* restrict buf, size_t, const char fmt[restrict static 1], ...);
 
+// Same as their counterparts above, but take a format string pre-scanned with
+// pf_compile_format() declared in format_scanning.h.
+
+struct PFCompiledFormat;
+
+int pf_vsnprintf_compiled(
+    char* restrict buf,
+    size_t,
+    const struct PFCompiledFormat* restrict fmt,
+    va_list args);
+int pf_vfprintf_compiled(
+    FILE stream[restrict static 1],
+    const struct PFCompiledFormat* restrict fmt,
+    va_list args);
+
+int pf_snprintf_compiled(
+    char* restrict buf,
+    size_t,
+    const struct PFCompiledFormat* restrict fmt,
+    ...);
+int pf_fprintf_compiled(
+    FILE stream[restrict static 1],
+    const struct PFCompiledFormat* restrict fmt,
+    ...);
+
+// Return the length of the output like pf_snprintf(NULL, 0, ...), but without
+// generating digits where it can be avoided. Floats with "%g", or rounding to a
+// power of ten at the given precision, are still formatted to find out.
+
+int pf_vformatted_length(const char fmt[restrict static 1], va_list args);
+
+__attribute__((format (printf, 1, 2)))
+int pf_formatted_length(const char fmt[restrict static 1], ...);
+
+// Output destination for pf_sinkprintf(). Output is formatted to buffer in a
+// single pass and handed to write() in chunks whenever buffer gets full and
+// once at the end, so output of any size can be streamed without allocating.
+// write() may replace buffer and capacity, which will be used for the next
+// chunk. capacity should be at least PF_SINK_MIN_CAPACITY.
+typedef struct PFSink
+{
+    void (*write)(struct PFSink* sink, const char* data, size_t length);
+    void* context; // for user, not used by pf_sinkprintf()
+    char* buffer;
+    size_t capacity;
+} PFSink;
+
+#define PF_SINK_MIN_CAPACITY 64
+
+// Returns the total length of the output. Output is not null-terminated.
+int pf_vsinkprintf(
+    PFSink sink[restrict static 1], const char fmt[restrict static 1], va_list args);
+
+__attribute__((format (printf, 2, 3)))
+int pf_sinkprintf(
+    PFSink sink[restrict static 1], const char fmt[restrict static 1], ...);
+
+// Allocate a null-terminated result with malloc() and store it to *out. Output
+// is formatted only once to a buffer that grows geometrically, so it is likely
+// to have some unused capacity. Returns the length of the output or -1 if
+// allocation failed, in which case *out is NULL.
+
+int pf_vasprintf(
+    char** restrict out, const char fmt[restrict static 1], va_list args);
+
+__attribute__((format (printf, 2, 3)))
+int pf_asprintf(char** restrict out, const char fmt[restrict static 1], ...);
+
+// Same as above, but shrink the result to exact size with realloc().
+
+int pf_vasprintf_shrink(
+    char** restrict out, const char fmt[restrict static 1], va_list args);
+
+__attribute__((format (printf, 2, 3)))
+int pf_asprintf_shrink(
+    char** restrict out, const char fmt[restrict static 1], ...);
+
+// Same as pf_asprintf_shrink(), but allocate with allocator declared in
+// allocator.h.
+
+struct PFAllocator;
+
+int pf_vaprintf(
+    const struct PFAllocator* restrict allocator,
+    char** restrict out,
+    const char fmt[restrict static 1],
+    va_list args);
+
+__attribute__((format (printf, 3, 4)))
+int pf_aprintf(
+    const struct PFAllocator* restrict allocator,
+    char** restrict out,
+    const char fmt[restrict static 1],
+    ...);
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+
+// Write to a file descriptor directly without stdio. Returns -1 if write()
+// fails or writes nothing, in which case the rest of the output is discarded.
+
+int pf_vdprintf(int fd, const char fmt[restrict static 1], va_list args);
+
+__attribute__((format (printf, 2, 3)))
+int pf_dprintf(int fd, const char fmt[restrict static 1], ...);
+
+#define PF_BATCH_BUFFER_SIZE 4096
+#define PF_BATCH_MAX_RECORDS 64
+
+// Collects records formatted with pf_batch_printf() to be written to fd with a
+// single writev() by pf_batch_flush(). The batch is also flushed when it gets
+// full, so records of any length can be added. Initialize with
+// PFBatch batch = { .fd = fd };
+typedef struct PFBatch
+{
+    int fd;
+    int count;     // records not yet written
+    size_t length; // used length of buffer
+    struct iovec records[PF_BATCH_MAX_RECORDS];
+    char buffer[PF_BATCH_BUFFER_SIZE];
+} PFBatch;
+
+// Returns the length of the record or -1 if the batch got full and flushing it
+// failed like in pf_batch_flush().
+int pf_vbatch_printf(
+    PFBatch batch[restrict static 1], const char fmt[restrict static 1], va_list args);
+
+__attribute__((format (printf, 2, 3)))
+int pf_batch_printf(
+    PFBatch batch[restrict static 1], const char fmt[restrict static 1], ...);
+
+// Returns 0 on success or -1 if writev() failed or wrote nothing, in which case
+// the batch is emptied anyway. Interrupted writes are retried.
+int pf_batch_flush(PFBatch batch[static 1]);
+
+#endif // defined(__unix__) || defined(__APPLE__)
+
 #endif // PRINTF_H_INCLUDED
@@ -0,0 +1,83 @@
+// MIT License
+// Copyright (c) 2023 Lauri Lorenzo Fiestas
+// https://github.com/PrinssiFiestas/printf/blob/main/LICENSE.md
+
+#include <printf/allocator.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdalign.h>
+
+static void* heap_alloc(void* context, size_t size)
+{
+    (void)context;
+    return malloc(size);
+}
+
+static void* heap_realloc(
+    void* context, void* ptr, size_t old_size, size_t new_size)
+{
+    (void)context; (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void heap_free(void* context, void* ptr, size_t size)
+{
+    (void)context; (void)size;
+    free(ptr);
+}
+
+const PFAllocator pf_heap_allocator = {
+    heap_alloc, heap_realloc, heap_free, NULL
+};
+
+// ---------------------------------------------------------------------------
+
+static void* arena_alloc(void* context, size_t size)
+{
+    PFArena* arena = context;
+    const uintptr_t align = alignof(max_align_t);
+    const uintptr_t end   = (uintptr_t)arena->memory + arena->position;
+    const size_t start =
+        ((end + align - 1) & ~(align - 1)) - (uintptr_t)arena->memory;
+    if (start > arena->capacity || size > arena->capacity - start)
+        return NULL;
+
+    arena->last     = start;
+    arena->position = start + size;
+    return (char*)arena->memory + start;
+}
+
+static void* arena_realloc(
+    void* context, void* ptr, size_t old_size, size_t new_size)
+{
+    PFArena* arena = context;
+    if (ptr == NULL)
+        return arena_alloc(arena, new_size);
+
+    if (ptr == (char*)arena->memory + arena->last) // resize in place
+    {
+        if (new_size > arena->capacity - arena->last)
+            return NULL;
+        arena->position = arena->last + new_size;
+        return ptr;
+    }
+
+    void* new_ptr = arena_alloc(arena, new_size);
+    if (new_ptr != NULL)
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    return new_ptr;
+}
+
+static void arena_free(void* context, void* ptr, size_t size)
+{
+    (void)size;
+    PFArena* arena = context;
+    if (ptr == (char*)arena->memory + arena->last)
+        arena->position = arena->last;
+}
+
+PFAllocator pf_arena_allocator(PFArena* arena)
+{
+    return (PFAllocator){ arena_alloc, arena_realloc, arena_free, arena };
+}
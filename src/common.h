@@ -26,23 +26,65 @@
 #define RYU_32_BIT_PLATFORM
 #endif
 
+// Build with -DPF_MULTI_ISA=1 to compile the floating point conversion kernels
+// for x86-64 microarchitecture levels v1 to v4. The dynamic linker picks the
+// clone for the running CPU once at load time using ifunc. Needs GCC 11 or
+// later and glibc, ignored otherwise.
+#ifndef PF_MULTI_ISA
+#define PF_MULTI_ISA 0
+#endif
+#if PF_MULTI_ISA && defined(__x86_64__) && defined(__ELF__) && defined(__GLIBC__) \
+  && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#define PF_TARGET_CLONES __attribute__((target_clones( \
+  "default", "arch=x86-64-v2", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+#define PF_TARGET_CLONES
+#endif
+
+// 10^0 to 10^19, all powers of ten that fit 64 bits.
+static const uint64_t POW10_UINT64[20] = {
+  1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u,
+  1000000000u, 10000000000u, 100000000000u, 1000000000000u, 10000000000000u,
+  100000000000000u, 1000000000000000u, 10000000000000000u,
+  100000000000000000u, 1000000000000000000u, 10000000000000000000u
+};
+
+// Digit counts below don't branch on the value, so mixed lengths don't cause
+// mispredictions. t = bits * 1233 >> 12 approximates log_10(2^bits), so a value
+// with 1 <= bits <= 128 significant bits has t or t + 1 digits. v | 1 counts 0
+// as one digit and keeps __builtin_clz() defined.
+
 // Returns the number of decimal digits in v, which must not contain more than 9 digits.
 static inline uint32_t decimalLength9(const uint32_t v) {
   // Function precondition: v is not a 10-digit number.
   // (f2s: 9 digits are sufficient for round-tripping.)
   // (d2fixed: We print 9-digit blocks.)
   assert(v < 1000000000);
-  if (v >= 100000000) { return 9; }
-  if (v >= 10000000) { return 8; }
-  if (v >= 1000000) { return 7; }
-  if (v >= 100000) { return 6; }
-  if (v >= 10000) { return 5; }
-  if (v >= 1000) { return 4; }
-  if (v >= 100) { return 3; }
-  if (v >= 10) { return 2; }
-  return 1;
+  const uint32_t x = v | 1;
+  const uint32_t t = ((uint32_t) (32 - __builtin_clz(x)) * 1233) >> 12;
+  return t + (x >= POW10_UINT64[t]);
 }
 
+// Returns the number of decimal digits in v, 1 for 0.
+static inline uint32_t decimalLength20(const uint64_t v) {
+  const uint64_t x = v | 1;
+  const uint32_t t = ((uint32_t) (64 - __builtin_clzll(x)) * 1233) >> 12;
+  return t + (x >= POW10_UINT64[t]);
+}
+
+#if defined(__SIZEOF_INT128__)
+// Returns the number of decimal digits in v, 1 for 0.
+static inline uint32_t decimalLength39(const unsigned __int128 v) {
+  const uint64_t high = (uint64_t) (v >> 64);
+  if (high == 0) {
+    return decimalLength20((uint64_t) v);
+  }
+  // t is 19 to 38, 10^t = 10^19 * 10^(t - 19)
+  const uint32_t t = ((uint32_t) (128 - __builtin_clzll(high)) * 1233) >> 12;
+  return t + (v >= (unsigned __int128) POW10_UINT64[19] * POW10_UINT64[t - 19]);
+}
+#endif
+
 // Returns e == 0 ? 1 : [log_2(5^e)]; requires 0 <= e <= 3528.
 static inline int32_t log2pow5(const int32_t e) {
   // This approximation works up to the point that the multiplication overflows at e = 3529.
@@ -7,14 +7,32 @@
 #include "ryu.h"
 #include "common.h"
 #include "digit_table.h"
+
+// Build with -DPF_LAZY_POW10_TABLES=1 to compute the ~100 KiB of POW10_SPLIT
+// and POW10_SPLIT_2 on first use instead of embedding them in the binary.
+#ifndef PF_LAZY_POW10_TABLES
+#define PF_LAZY_POW10_TABLES 0
+#endif
+#if PF_LAZY_POW10_TABLES
+#define RYU_NO_POW10_SPLIT 1
+#endif
 #include "d2fixed_full_table.h"
 #include "d2s_intrinsics.h"
 #include "pfstring.h"
 
 #include <inttypes.h>
+#include <float.h>
 #include <math.h>
 #include <limits.h>
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#define PF_SIMD_UTOA 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#else
+#define PF_SIMD_UTOA 0
+#endif
+
 #define DOUBLE_MANTISSA_BITS 52
 #define DOUBLE_EXPONENT_BITS 11
 #define DOUBLE_BIAS 1023
@@ -28,6 +46,7 @@
 #define MAX_DIGITS ((CHAR_BIT * sizeof(uintmax_t) * 3) / 8)
 #endif
 
+#if UINTMAX_MAX > UINT64_MAX
 static void str_reverse_copy(
     char* restrict out,
     char* restrict buf,
@@ -41,36 +60,197 @@ static void str_reverse_copy(
     if (length < max)
         out[length] = '\0';
 }
+#endif
 
 static inline void
 append_n_digits(const uint32_t olength, uint32_t digits, char* const result);
+static inline void
+append_nine_digits(uint32_t digits, char* const result);
 
-unsigned pf_utoa(const size_t n, char* out, uintmax_t x)
+// Writes all digits of x from high to low using 9-digit chunks. result must
+// have space for 20 characters. Returns the number of digits.
+static inline unsigned append_u64_digits(const uint64_t x, char* const result)
 {
-    if (n >= 10 && x < 1000000000) // use optimized
+    if (x < 1000000000)
     {
-        const uint32_t olength = decimalLength9(x);
-        append_n_digits(olength, x, out);
-        out[olength] = '\0';
+        const uint32_t olength = decimalLength9((uint32_t)x);
+        append_n_digits(olength, (uint32_t)x, result);
         return olength;
     }
+    if (x < 1000000000000000000u)
+    {
+        const uint32_t high = (uint32_t)(x / 1000000000);
+        const uint32_t low  = (uint32_t)(x - high * UINT64_C(1000000000));
+        const uint32_t olength = decimalLength9(high);
+        append_n_digits(olength, high, result);
+        append_nine_digits(low, result + olength);
+        return olength + 9;
+    }
+    // x >= 10^18 so top is 1 to 18
+    const uint32_t top  = (uint32_t)(x / 1000000000000000000u);
+    const uint64_t rest = x - top * UINT64_C(1000000000000000000);
+    const uint32_t mid  = (uint32_t)(rest / 1000000000);
+    const uint32_t low  = (uint32_t)(rest - mid * UINT64_C(1000000000));
+    const uint32_t olength = top >= 10 ? 2 : 1;
+    append_n_digits(olength, top, result);
+    append_nine_digits(mid, result + olength);
+    append_nine_digits(low, result + olength + 9);
+    return olength + 18;
+}
 
-    char buf[MAX_DIGITS];
-    size_t i = 0;
-    do // write all digits from low to high
+#if PF_SIMD_UTOA
+// Converts x < 10^8 to 16-bit lanes [a, b, c, d, e, f, g, h] without branches
+// using multiplications by reciprocals.
+static inline __m128i eight_digits_sse2(const uint32_t x)
+{
+    // abcd, efgh = abcdefgh divmod 10^4
+    const __m128i abcdefgh = _mm_cvtsi32_si128(x);
+    const __m128i abcd = _mm_srli_epi64(
+        _mm_mul_epu32(abcdefgh, _mm_set1_epi32(0xd1b71759)), 45);
+    const __m128i efgh = _mm_sub_epi32(
+        abcdefgh, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+
+    // [4abcd, 4abcd, 4abcd, 4abcd, 4efgh, 4efgh, 4efgh, 4efgh]
+    const __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+    const __m128i v2 = _mm_unpacklo_epi16(v1, v1);
+    const __m128i v3 = _mm_unpacklo_epi32(v2, v2);
+
+    // Divide by 10^3, 10^2, 10^1, and 10^0 to get
+    // [a, ab, abc, abcd, e, ef, efg, efgh]
+    const __m128i v4 = _mm_mulhi_epu16(v3, _mm_setr_epi16(
+        8389, 5243, 13108, (short)32768, 8389, 5243, 13108, (short)32768));
+    const __m128i v5 = _mm_mulhi_epu16(v4, _mm_setr_epi16(
+        1 << 7, 1 << 11, 1 << 13, (short)(1 << 15),
+        1 << 7, 1 << 11, 1 << 13, (short)(1 << 15)));
+
+    // Subtract previous lane times 10 to get [a, b, c, d, e, f, g, h]
+    const __m128i v6 = _mm_slli_epi64(_mm_mullo_epi16(v5, _mm_set1_epi16(10)), 16);
+    return _mm_sub_epi16(v5, v6);
+}
+
+// All 16 digits of x < 10^16 in ASCII, most significant first.
+static inline __m128i sixteen_digits_sse2(const uint64_t x)
+{
+    const uint32_t high = (uint32_t)(x / 100000000);
+    const uint32_t low  = (uint32_t)(x - high * UINT64_C(100000000));
+    return _mm_add_epi8(
+        _mm_packus_epi16(eight_digits_sse2(high), eight_digits_sse2(low)),
+        _mm_set1_epi8('0'));
+}
+
+// Leading '0' characters of digits to be trimmed. At least one digit is kept.
+static inline unsigned leading_zeroes_sse2(const __m128i digits)
+{
+    const unsigned zeroes = (unsigned)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(digits, _mm_set1_epi8('0')));
+    return (unsigned)__builtin_ctz(~zeroes | 0x8000);
+}
+
+// Writes digits above 16 and returns their count, which is 0 if x < 10^16.
+// Updates x to hold the last 16 digits.
+static inline unsigned append_top_digits(uint64_t x[static 1], char* result)
+{
+    if (*x < UINT64_C(10000000000000000))
+        return 0;
+    const uint32_t top = (uint32_t)(*x / UINT64_C(10000000000000000));
+    const uint32_t olength = decimalLength9(top);
+    append_n_digits(olength, top, result);
+    *x -= top * UINT64_C(10000000000000000);
+    return olength;
+}
+
+// Same as append_u64_digits(). x86-64 always has SSE2.
+static unsigned append_u64_digits_sse2(uint64_t x, char* const result)
+{
+    const unsigned top_length = append_top_digits(&x, result);
+    const __m128i digits = sixteen_digits_sse2(x);
+    if (top_length != 0)
+    {
+        _mm_storeu_si128((__m128i*)(result + top_length), digits);
+        return top_length + 16;
+    }
+    const unsigned zeroes = leading_zeroes_sse2(digits);
+    char buf[16];
+    _mm_storeu_si128((__m128i*)buf, digits);
+    memcpy(result, buf + zeroes, 16 - zeroes);
+    return 16 - zeroes;
+}
+
+// Same as append_u64_digits_sse2(), but trims leading zeroes with a shuffle.
+// May write garbage after the digits. result must have space for 20
+// characters anyway.
+__attribute__((target("ssse3")))
+static unsigned append_u64_digits_ssse3(uint64_t x, char* const result)
+{
+    static const signed char shift_left[32] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+    };
+    const unsigned top_length = append_top_digits(&x, result);
+    const __m128i digits = sixteen_digits_sse2(x);
+    if (top_length != 0)
     {
-        buf[i++] = x % 10 + '0';
-        x /= 10;
-    } while(x);
+        _mm_storeu_si128((__m128i*)(result + top_length), digits);
+        return top_length + 16;
+    }
+    const unsigned zeroes = leading_zeroes_sse2(digits);
+    _mm_storeu_si128((__m128i*)result, _mm_shuffle_epi8(
+        digits, _mm_loadu_si128((const __m128i*)(shift_left + zeroes))));
+    return 16 - zeroes;
+}
+#endif // PF_SIMD_UTOA
 
-    str_reverse_copy(out, buf, i, n);
-    return i;
+// Uses the fastest implementation available on the running CPU. Table lookups
+// are faster for values that fit in a single chunk.
+static inline unsigned append_u64_digits_fast(const uint64_t x, char* const result)
+{
+    #if PF_SIMD_UTOA
+    if (x < 100000000)
+        return append_u64_digits(x, result);
+    if (__builtin_cpu_supports("ssse3"))
+        return append_u64_digits_ssse3(x, result);
+    return append_u64_digits_sse2(x, result);
+    #else
+    return append_u64_digits(x, result);
+    #endif
 }
 
-unsigned pf_itoa(size_t n, char* out, const intmax_t ix)
+unsigned pf_utoa(const size_t n, char* out, uintmax_t x)
 {
-    char buf[MAX_DIGITS];
+    #if UINTMAX_MAX > UINT64_MAX
+    if (x > UINT64_MAX)
+    {
+        char buf[MAX_DIGITS];
+        size_t i = 0;
+        do // write all digits from low to high
+        {
+            buf[i++] = x % 10 + '0';
+            x /= 10;
+        } while(x);
+
+        str_reverse_copy(out, buf, i, n);
+        return i;
+    }
+    #endif
+
+    if (n >= 20) // enough space for any 64-bit value, write directly
+    {
+        const unsigned length = append_u64_digits_fast(x, out);
+        if (length < n)
+            out[length] = '\0';
+        return length;
+    }
+
+    char buf[20];
+    const unsigned length = append_u64_digits_fast(x, buf);
+    memcpy(out, buf, length < n ? length : n);
+    if (length < n)
+        out[length] = '\0';
+    return length;
+}
 
+unsigned pf_itoa(size_t n, char* out, const intmax_t ix)
+{
     if (ix < 0)
     {
         if (n > 0)
@@ -80,78 +260,246 @@ unsigned pf_itoa(size_t n, char* out, const intmax_t ix)
         }
         out++;
     }
+    // Negate as unsigned to not overflow with INTMAX_MIN
+    const uintmax_t x = ix < 0 ? -(uintmax_t)ix : (uintmax_t)ix;
+    return pf_utoa(n, out, x) + (ix < 0);
+}
 
-    uintmax_t x = imaxabs(ix);
-    size_t i = 0;
-    do // write all digits from low to high
+// Tables of all two-digit hexadecimal and octal numbers. Like DIGIT_TABLE, these
+// are used to copy pairs of digits into the final output.
+
+static const char HEX_TABLE_LOWER[513] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static const char HEX_TABLE_UPPER[513] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+static const char OCTAL_TABLE[129] =
+    "0001020304050607101112131415161720212223242526273031323334353637"
+    "4041424344454647505152535455565760616263646566677071727374757677";
+
+// Writes olength digits of x in base 2^bits. Digits are written from the end in
+// pairs so they are already in final order.
+static inline void append_pow2_digits(
+    uintmax_t x,
+    const unsigned bits,
+    const char table[static 1],
+    unsigned olength,
+    char* const result)
+{
+    const unsigned mask = (1u << 2 * bits) - 1;
+    while (olength >= 2)
     {
-        buf[i++] = x % 10 + '0';
-        x /= 10;
-    } while(x);
-
-    str_reverse_copy(out, buf, i, n);
-    return i + (ix < 0);
+        olength -= 2;
+        memcpy(result + olength, table + 2 * (x & mask), 2);
+        x >>= 2 * bits;
+    }
+    if (olength == 1)
+        result[0] = table[2 * (x & mask) + 1];
 }
 
-unsigned pf_otoa(const size_t n, char* out, uintmax_t x)
+static unsigned pow2_toa(
+    const size_t n,
+    char* out,
+    const uintmax_t x,
+    const unsigned bits,
+    const char table[static 1])
 {
-    char buf[MAX_DIGITS];
-    size_t i = 0;
-    do // write all digits from low to high
+    const unsigned bit_length =
+        x == 0 ? 1 : sizeof(x) * CHAR_BIT - __builtin_clzll(x);
+    const unsigned olength = (bit_length + bits - 1) / bits;
+
+    if (olength < n)
     {
-        buf[i++] = x % 8 + '0';
-        x /= 8;
-    } while(x);
+        append_pow2_digits(x, bits, table, olength, out);
+        out[olength] = '\0';
+        return olength;
+    }
+    char buf[MAX_DIGITS];
+    append_pow2_digits(x, bits, table, olength, buf);
+    memcpy(out, buf, n);
+    return olength;
+}
 
-    str_reverse_copy(out, buf, i, n);
-    return i;
+unsigned pf_otoa(const size_t n, char* out, uintmax_t x)
+{
+    return pow2_toa(n, out, x, 3, OCTAL_TABLE);
 }
 
 unsigned pf_xtoa(const size_t n, char* out, uintmax_t x)
 {
-    char buf[MAX_DIGITS];
-    size_t i = 0;
-    do // write all digits from low to high
+    return pow2_toa(n, out, x, 4, HEX_TABLE_LOWER);
+}
+
+unsigned pf_Xtoa(const size_t n, char* out, uintmax_t x)
+{
+    return pow2_toa(n, out, x, 4, HEX_TABLE_UPPER);
+}
+
+#if defined(__SIZEOF_INT128__)
+// Writes all digits of x in 19-digit chunks from high to low. result must have
+// space for 39 characters.
+static unsigned append_u128_digits(unsigned __int128 x, char* const result)
+{
+    const uint64_t chunk = UINT64_C(10000000000000000000); // 10^19
+    uint64_t chunks[2];
+    unsigned count = 0;
+    while (x >= chunk)
     {
-        unsigned _x = x % 16;
-        buf[i++] = _x < 10 ? _x + '0' : _x - 10 + 'a';
-        x /= 16;
-    } while(x);
+        const unsigned __int128 quotient = x / chunk;
+        chunks[count++] = (uint64_t)(x - quotient * chunk);
+        x = quotient;
+    }
 
-    str_reverse_copy(out, buf, i, n);
-    return i;
+    unsigned length = append_u64_digits_fast((uint64_t)x, result);
+    while (count > 0)
+    {
+        const uint64_t digits = chunks[--count];
+        const uint64_t low = digits % UINT64_C(1000000000000000000);
+        result[length] = (char)('0' + digits / UINT64_C(1000000000000000000));
+        append_nine_digits((uint32_t)(low / 1000000000), result + length + 1);
+        append_nine_digits((uint32_t)(low % 1000000000), result + length + 10);
+        length += 19;
+    }
+    return length;
 }
 
-unsigned pf_Xtoa(const size_t n, char* out, uintmax_t x)
+unsigned pf_u128toa(const size_t n, char* out, const unsigned __int128 x)
 {
-    char buf[MAX_DIGITS];
-    size_t i = 0;
-    do // write all digits from low to high
+    if (x <= UINT64_MAX)
+        return pf_utoa(n, out, (uint64_t)x);
+
+    char buf[40];
+    const unsigned length = append_u128_digits(x, n > 39 ? out : buf);
+    if (n <= 39)
+        memcpy(out, buf, length < n ? length : n);
+    if (length < n)
+        out[length] = '\0';
+    return length;
+}
+
+unsigned pf_i128toa(size_t n, char* out, const __int128 ix)
+{
+    if (ix < 0)
+    {
+        if (n > 0)
+        {
+            out[0] = '-';
+            n--;
+        }
+        out++;
+    }
+    const unsigned __int128 x =
+        ix < 0 ? -(unsigned __int128)ix : (unsigned __int128)ix;
+    return pf_u128toa(n, out, x) + (ix < 0);
+}
+
+unsigned pf_pow2_u128toa(
+    const size_t n,
+    char* out,
+    unsigned __int128 x,
+    const unsigned char conversion)
+{
+    const unsigned bits = conversion == 'o' ? 3 : 4;
+    const char* table =
+        conversion == 'o' ? OCTAL_TABLE :
+        conversion == 'x' ? HEX_TABLE_LOWER : HEX_TABLE_UPPER;
+
+    if (x <= UINT64_MAX)
+        return pow2_toa(n, out, (uint64_t)x, bits, table);
+
+    const unsigned bit_length = 128 - __builtin_clzll((uint64_t)(x >> 64));
+    const unsigned olength = (bit_length + bits - 1) / bits;
+
+    // Split to chunks of as many whole digits as fit in 64 bits
+    const unsigned chunk_bits   = 64 - 64 % bits;
+    const unsigned chunk_digits = chunk_bits / bits;
+    const uint64_t chunk_mask   = UINT64_MAX >> (64 - chunk_bits);
+
+    char buf[48];
+    char* result = n > olength ? out : buf;
+    unsigned remaining = olength;
+    while (remaining > chunk_digits)
     {
-        unsigned _x = x % 16;
-        buf[i++] = _x < 10 ? _x + '0' : _x - 10 + 'A';
-        x /= 16;
-    } while(x);
+        remaining -= chunk_digits;
+        append_pow2_digits(
+            (uint64_t)x & chunk_mask, bits, table, chunk_digits, result + remaining);
+        x >>= chunk_bits;
+    }
+    append_pow2_digits((uint64_t)x, bits, table, remaining, result);
 
-    str_reverse_copy(out, buf, i, n);
-    return i;
+    if (result == buf)
+        memcpy(out, buf, n);
+    else
+        out[olength] = '\0';
+    return olength;
 }
+#endif // defined(__SIZEOF_INT128__)
 
 // ---------------------------------------------------------------------------
 
+PF_TARGET_CLONES
+static unsigned
+write_fixed(struct PFString out[static 1], PFFormatSpecifier fmt, double d);
+
+PF_TARGET_CLONES
+static unsigned
+write_exp(struct PFString out[static 1], PFFormatSpecifier fmt, double d);
+
+static unsigned
+write_shortest(struct PFString out[static 1], PFFormatSpecifier fmt, double d);
+
+static unsigned
+write_hex(struct PFString out[static 1], PFFormatSpecifier fmt, double d);
+
+PF_TARGET_CLONES
+static unsigned
+write_float(struct PFString out[static 1], PFFormatSpecifier fmt, float f);
+
+static bool
+write_small_double(
+    struct PFString out[static 1], PFFormatSpecifier fmt, uint64_t m2, int32_t e2);
+
+PF_TARGET_CLONES
+static unsigned
+write_long_double(
+    struct PFString out[static 1], PFFormatSpecifier fmt, long double f);
+
 static unsigned
 pf_d2fixed_buffered_n(
-    char* result,
-    size_t n,
-    PFFormatSpecifier fmt,
-    double d);
+    char* const result,
+    const size_t n,
+    const PFFormatSpecifier fmt,
+    const double d)
+{
+    struct PFString out = { result, .capacity = n };
+    return write_fixed(&out, fmt, d);
+}
 
 static unsigned
 pf_d2exp_buffered_n(
-    char* result,
+    char* const result,
     const size_t n,
-    PFFormatSpecifier fmt,
-    double d);
+    const PFFormatSpecifier fmt,
+    const double d)
+{
+    struct PFString out = { result, .capacity = n };
+    return write_exp(&out, fmt, d);
+}
 
 unsigned
 pf_ftoa(const size_t n, char* const buf, const double f)
@@ -195,16 +543,89 @@ pf_Gtoa(const size_t n, char* const buf, const double f)
     return pf_d2exp_buffered_n(buf, n, fmt, f);
 }
 
+unsigned
+pf_atoa(const size_t n, char* const buf, const double f)
+{
+    const PFFormatSpecifier fmt = {.conversion_format = 'a'};
+    struct PFString out = { buf, .capacity = n };
+    return write_hex(&out, fmt, f);
+}
+
+unsigned
+pf_Atoa(const size_t n, char* const buf, const double f)
+{
+    const PFFormatSpecifier fmt = {.conversion_format = 'A'};
+    struct PFString out = { buf, .capacity = n };
+    return write_hex(&out, fmt, f);
+}
+
+unsigned
+pf_dtoa_shortest(const size_t n, char* const buf, const double f)
+{
+    const PFFormatSpecifier fmt = {.conversion_format = 'r'};
+    struct PFString out = { buf, .capacity = n };
+    return write_shortest(&out, fmt, f);
+}
+
 unsigned pf_strfromd(
     char* const buf,
     const size_t n,
     const PFFormatSpecifier fmt,
     const double f)
+{
+    struct PFString out = { buf, .capacity = n };
+    return pf_strfromd_to_string(&out, fmt, f);
+}
+
+unsigned pf_strfromd_to_string(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const double f)
 {
     if (fmt.conversion_format == 'f' || fmt.conversion_format == 'F')
-        return pf_d2fixed_buffered_n(buf, n, fmt, f);
+        return write_fixed(out, fmt, f);
+    else if (fmt.conversion_format == 'r' || fmt.conversion_format == 'R')
+        return write_shortest(out, fmt, f);
+    else if (fmt.conversion_format == 'a' || fmt.conversion_format == 'A')
+        return write_hex(out, fmt, f);
     else
-        return pf_d2exp_buffered_n(buf, n, fmt, f);
+        return write_exp(out, fmt, f);
+}
+
+unsigned pf_strfromf(
+    char* const buf,
+    const size_t n,
+    const PFFormatSpecifier fmt,
+    const float f)
+{
+    struct PFString out = { buf, .capacity = n };
+    return write_float(&out, fmt, f);
+}
+
+unsigned pf_strfromf_to_string(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const float f)
+{
+    return write_float(out, fmt, f);
+}
+
+unsigned pf_strfromld(
+    char* const buf,
+    const size_t n,
+    const PFFormatSpecifier fmt,
+    const long double f)
+{
+    struct PFString out = { buf, .capacity = n };
+    return write_long_double(&out, fmt, f);
+}
+
+unsigned pf_strfromld_to_string(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const long double f)
+{
+    return write_long_double(out, fmt, f);
 }
 
 // ---------------------------------------------------------------------------
@@ -351,10 +772,10 @@ pf_append_d_digits(
     const uint32_t maximum, // first_available_digits
     const uint32_t digits)
 {
-    if (capacity_left(*out) >= maximum) // write directly
+    if (capacity_left(*out) >= maximum + strlen(".")) // write directly
     {
         append_d_digits(
-            maximum, digits, out->data + out->length);
+            maximum, digits, end(*out));
         out->length += maximum + strlen(".");
     }
     else // write only as much as fits
@@ -395,7 +816,7 @@ pf_append_c_digits(
     if (capacity_left(*out) >= count) // write directly
     {
         append_c_digits(
-            count, digits, out->data + out->length);
+            count, digits, end(*out));
         out->length += count;
     }
     else // write only as much as fits
@@ -439,7 +860,7 @@ pf_append_nine_digits(struct PFString out[static 1], uint32_t digits)
 {
     if (capacity_left(*out) >= 9) // write directly
     {
-        append_nine_digits(digits, out->data + out->length);
+        append_nine_digits(digits, end(*out));
         out->length += 9;
     }
     else // write only as much as fits
@@ -456,7 +877,7 @@ append_utoa(struct PFString out[static 1], uint32_t digits)
     if (capacity_left(*out) >= 9) // write directly
     {
         out->length += pf_utoa(
-            capacity_left(*out), out->data + out->length, digits);
+            capacity_left(*out), end(*out), digits);
     }
     else // write only as much as fits
     {
@@ -484,383 +905,673 @@ static inline uint32_t lengthForIndex(const uint32_t idx)
 
 // ---------------------------------------------------------------------------
 //
-// START OF MODIFIED RYU
+// Lazy POW10_SPLIT tables
+//
+// Entries are 192-bit values reduced modulo 10^9 * 2^136, which doesn't change
+// the result of mulShift_mod1e9(). They are computed with 32-bit limbs:
+//   POW10_SPLIT  [POW10_OFFSET[idx] + i]:  2^(16 idx + 120) / 10^(9 i) + 1
+//   POW10_SPLIT_2[POW10_OFFSET_2[idx] + i - MIN_BLOCK_2[idx]]:
+//       10^(9 (i + 1)) * 2^120 / 2^(16 idx)
+// Rows are computed on first use by a single thread. Other threads that need
+// the row meanwhile compute their own entries like pf_static_spec_scan() does.
+//
+// ---------------------------------------------------------------------------
 
-static inline unsigned
-pf_copy_special_str_printf(
-    struct PFString out[const static 1],
-    const uint64_t mantissa,
-    const bool uppercase)
+// Entries are computed in all builds so that tests can check them against the
+// embedded tables. Inline, so unused functions don't warn.
+
+#define POW10_MAX_LIMBS 120 // 10^(9 * 121) * 2^120 has 3738 bits
+
+// Store (x + add) mod (10^9 * 2^136) to result. x has length limbs, which are
+// overwritten.
+static inline void
+pow10_entry(
+    uint32_t x[static POW10_MAX_LIMBS],
+    unsigned length,
+    const uint32_t add,
+    uint64_t result[static 3])
 {
-    if (mantissa != 0)
-    {
-        concat(out, uppercase ? "NAN" : "nan", strlen("nan"));
-        if (capacity_left(*out))
-            out->data[out->length] = '\0';
-        return out->length;
-    }
-    else
+    uint64_t carry = add;
+    for (unsigned i = 0; i < length && carry != 0; i++)
     {
-        concat(out, uppercase ? "INF" : "inf", strlen("inf"));
-        if (capacity_left(*out))
-            out->data[out->length] = '\0';
-        return out->length;
+        carry += x[i];
+        x[i]   = (uint32_t)carry;
+        carry >>= 32;
     }
+    if (carry != 0)
+        x[length++] = (uint32_t)carry;
+    while (length < 5)
+        x[length++] = 0;
+
+    // x >> 136 mod 10^9 as a remainder of short division from the top
+    uint64_t remainder = 0;
+    for (unsigned i = length; i-- > 5;)
+        remainder = ((remainder << 32) | x[i]) % 1000000000;
+    remainder = ((remainder << 24) | (x[4] >> 8)) % 1000000000;
+
+    result[0] = (uint64_t)x[1] << 32 | x[0];
+    result[1] = (uint64_t)x[3] << 32 | x[2];
+    result[2] = remainder << 8 | (x[4] & 0xFF);
 }
 
-static unsigned
-pf_d2fixed_buffered_n(
-    char* const result,
-    const size_t n,
-    const PFFormatSpecifier fmt,
-    const double d)
+// Entries first to last of row idx of POW10_SPLIT to table.
+static inline void
+pow10_split_entries(
+    const uint32_t idx, const uint32_t first, const uint32_t last, uint64_t table[][3])
 {
-    struct PFString out = { result, .capacity = n };
-    const bool fmt_is_g =
-        fmt.conversion_format == 'g' || fmt.conversion_format == 'G';
-    unsigned precision;
-    if (fmt.precision.option == PF_SOME)
-        precision = fmt.precision.width;
-    else
-        precision = 6;
+    uint32_t x[POW10_MAX_LIMBS] = {0};
+    const uint32_t bits = pow10BitsForIndex(idx);
+    unsigned length = bits / 32 + 1;
+    x[bits / 32] = (uint32_t)1 << bits % 32;
 
-    const uint64_t bits = double_to_bits(d);
+    for (uint32_t i = 0; i < last; i++)
+    {
+        if (i >= first)
+        {
+            uint32_t copy[POW10_MAX_LIMBS];
+            memcpy(copy, x, length * sizeof x[0]);
+            pow10_entry(copy, length, 1, table[i - first]);
+        }
 
-    // Decode bits into sign, mantissa, and exponent.
-    const bool ieeeSign =
-        ((bits >> (DOUBLE_MANTISSA_BITS + DOUBLE_EXPONENT_BITS)) & 1) != 0;
-    const uint64_t ieeeMantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
-    const uint32_t ieeeExponent = (uint32_t)
-        ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+        uint64_t remainder = 0; // divide by 10^9
+        for (unsigned j = length; j-- > 0;)
+        {
+            const uint64_t y = remainder << 32 | x[j];
+            x[j]      = (uint32_t)(y / 1000000000);
+            remainder = y % 1000000000;
+        }
+        while (length > 1 && x[length - 1] == 0)
+            length--;
+    }
+}
 
-    if (ieeeSign)
-        push_char(&out, '-');
-    else if (fmt.flag.plus)
-        push_char(&out, '+');
-    else if (fmt.flag.space)
-        push_char(&out, ' ');
+// Blocks first to last of row idx of POW10_SPLIT_2 to table.
+static inline void
+pow10_split_2_entries(
+    const uint32_t idx, const uint32_t first, const uint32_t last, uint64_t table[][3])
+{
+    uint32_t power[POW10_MAX_LIMBS] = {1}; // 10^(9 (i + 1))
+    unsigned length = 1;
+    const int32_t shift = ADDITIONAL_BITS_2 - 16 * (int32_t)idx;
 
-    // Case distinction; exit early for the easy cases.
-    if (ieeeExponent == ((1u << DOUBLE_EXPONENT_BITS) - 1u))
+    for (uint32_t i = 0; i < last; i++)
     {
-        const bool uppercase =
-            fmt.conversion_format == 'F' || fmt.conversion_format == 'G';
-        return pf_copy_special_str_printf(&out, ieeeMantissa, uppercase);
+        uint64_t carry = 0; // multiply by 10^9
+        for (unsigned j = 0; j < length; j++)
+        {
+            carry   += (uint64_t)power[j] * 1000000000;
+            power[j] = (uint32_t)carry;
+            carry  >>= 32;
+        }
+        if (carry != 0)
+            power[length++] = (uint32_t)carry;
+        if (i < first)
+            continue;
+
+        uint32_t x[POW10_MAX_LIMBS] = {0};
+        unsigned x_length;
+        if (shift >= 0)
+        {
+            const unsigned words = shift / 32;
+            const unsigned bits  = shift % 32;
+            for (unsigned j = 0; j < length; j++)
+            {
+                x[j + words]     |= power[j] << bits;
+                x[j + words + 1]  = bits ? power[j] >> (32 - bits) : 0;
+            }
+            x_length = length + words + 1;
+        }
+        else
+        {
+            const unsigned words = -shift / 32;
+            const unsigned bits  = -shift % 32;
+            x_length = length > words ? length - words : 1;
+            for (unsigned j = 0; j + words < length; j++)
+                x[j] = power[j + words] >> bits |
+                    (bits && j + words + 1 < length ? power[j + words + 1] << (32 - bits) : 0);
+        }
+        pow10_entry(x, x_length, 0, table[i - first]);
     }
+}
 
-    if (ieeeExponent == 0 && ieeeMantissa == 0) // d == 0.0
+#if PF_LAZY_POW10_TABLES
+
+#define POW10_SPLIT_LENGTH   1224
+#define POW10_SPLIT_2_LENGTH 3133
+
+static uint64_t pow10_split_table[POW10_SPLIT_LENGTH][3];
+static uint64_t pow10_split_2_table[POW10_SPLIT_2_LENGTH][3];
+static unsigned pow10_split_state[TABLE_SIZE];     // 0: empty, 1: filling, 2: ready
+static unsigned pow10_split_2_state[TABLE_SIZE_2];
+
+// Fill the row of the table or compute entry index of it to scratch.
+static const uint64_t*
+pow10_row_entry(
+    unsigned state[static 1],
+    uint64_t table_row[][3],
+    const uint32_t row_length,
+    const uint32_t index,
+    uint64_t scratch[static 3],
+    void (*entries)(uint32_t idx, uint32_t first, uint32_t last, uint64_t table[][3]),
+    const uint32_t idx,
+    const uint32_t first)
+{
+    unsigned expected = 0;
+    if (__atomic_compare_exchange_n(
+        state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
     {
-        push_char(&out, '0');
-
-        if (precision > 0 || fmt.flag.hash)
-            push_char(&out, '.');
-        pad(&out, '0', precision);
-
-        if (capacity_left(out))
-            out.data[out.length] = '\0';
-        return out.length;
+        entries(idx, first, first + row_length, table_row);
+        __atomic_store_n(state, 2, __ATOMIC_RELEASE);
+        return table_row[index];
     }
+    if (expected == 2)
+        return table_row[index];
+    entries(idx, first + index, first + index + 1, (uint64_t(*)[3])scratch);
+    return scratch;
+}
 
-    int32_t e2;
-    uint64_t m2;
-    if (ieeeExponent == 0)
-    {
-        e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS;
-        m2 = ieeeMantissa;
-    }
-    else
-    {
-        e2 = (int32_t) ieeeExponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS;
-        m2 = (1ull << DOUBLE_MANTISSA_BITS) | ieeeMantissa;
-    }
+// POW10_SPLIT[POW10_OFFSET[idx] + i]
+static inline const uint64_t*
+pow10_split(const uint32_t idx, const uint32_t i, uint64_t scratch[static 3])
+{
+    uint64_t (*const row)[3] = pow10_split_table + POW10_OFFSET[idx];
+    if (__atomic_load_n(&pow10_split_state[idx], __ATOMIC_ACQUIRE) == 2)
+        return row[i];
+    const uint32_t end = idx + 1 < TABLE_SIZE ? POW10_OFFSET[idx + 1] : POW10_SPLIT_LENGTH;
+    return pow10_row_entry(&pow10_split_state[idx], row,
+        end - POW10_OFFSET[idx], i, scratch, pow10_split_entries, idx, 0);
+}
 
-    bool is_zero = true; // for now
+// POW10_SPLIT_2[p] where p is in row idx
+static inline const uint64_t*
+pow10_split_2(const uint32_t idx, const uint32_t p, uint64_t scratch[static 3])
+{
+    uint64_t (*const row)[3] = pow10_split_2_table + POW10_OFFSET_2[idx];
+    const uint32_t index = p - POW10_OFFSET_2[idx];
+    if (__atomic_load_n(&pow10_split_2_state[idx], __ATOMIC_ACQUIRE) == 2)
+        return row[index];
+    return pow10_row_entry(&pow10_split_2_state[idx], row,
+        POW10_OFFSET_2[idx + 1] - POW10_OFFSET_2[idx], index, scratch,
+        pow10_split_2_entries, idx, MIN_BLOCK_2[idx]);
+}
 
-    uint32_t all_digits[256] = {}; // significant digits without trailing zeroes
-    size_t digits_length = 0;
-    size_t integer_part_end = 0; // place for decimal point
+#else
+
+static inline const uint64_t*
+pow10_split(const uint32_t idx, const uint32_t i, uint64_t scratch[static 3])
+{
+    (void)scratch;
+    return POW10_SPLIT[POW10_OFFSET[idx] + i];
+}
+
+static inline const uint64_t*
+pow10_split_2(const uint32_t idx, const uint32_t p, uint64_t scratch[static 3])
+{
+    (void)idx; (void)scratch;
+    return POW10_SPLIT_2[p];
+}
+
+#endif // PF_LAZY_POW10_TABLES
+
+// ---------------------------------------------------------------------------
+//
+// START OF MODIFIED RYU
+
+static inline void
+pf_copy_special_str_printf(
+    struct PFString out[const static 1],
+    const uint64_t mantissa,
+    const bool uppercase)
+{
+    if (mantissa != 0)
+        concat(out, uppercase ? "NAN" : "nan", strlen("nan"));
+    else
+        concat(out, uppercase ? "INF" : "inf", strlen("inf"));
+    if (capacity_left(*out))
+        *end(*out) = '\0';
+}
+
+// Digits of write_fixed() are written in 9 digit blocks as soon as they are
+// generated. Rounding can only carry to the last block that is not 999999999,
+// so that block and the nines after it are held back. Fractional zero blocks
+// and the nonzero block before them are held back too while they might be
+// trailing zeroes that "%g" trims. This needs no buffer for the digits
+// regardless of precision.
+struct FixedDigits
+{
+    struct PFString* out;
+    size_t integer_blocks; // index of first fractional block
+    size_t count;          // blocks pushed
+    size_t held_index;
+    uint32_t held;         // block that gets the carry
+    size_t nines;          // 999999999 blocks after held
+    size_t zeroes;         // zero blocks before held if held is a zero block
+    uint32_t before_zeroes;
+    bool has_before_zeroes;
+    bool point_written;
+};
+
+static inline void
+fixed_point(struct FixedDigits d[static 1])
+{
+    if ( ! d->point_written)
+    {
+        push_char(d->out, '.');
+        d->point_written = true;
+    }
+}
+
+static inline void
+fixed_write_block(
+    struct FixedDigits d[static 1], const size_t index, const uint32_t block)
+{
+    if (index == 0)
+    {
+        append_utoa(d->out, block);
+        return;
+    }
+    if (index >= d->integer_blocks)
+        fixed_point(d);
+    pf_append_nine_digits(d->out, block);
+}
+
+// Fractional block without trailing zeroes.
+static inline void
+fixed_write_trimmed(struct FixedDigits d[static 1], uint32_t block)
+{
+    uint32_t length = 9;
+    while (block % 10 == 0)
+    {
+        block /= 10;
+        length--;
+    }
+    fixed_point(d);
+    pf_append_c_digits(d->out, length, block);
+}
+
+// Write blocks before held.
+static void
+fixed_flush_zeroes(struct FixedDigits d[static 1])
+{
+    size_t i = d->held_index - d->zeroes;
+    if (d->has_before_zeroes)
+        fixed_write_block(d, i - 1, d->before_zeroes);
+    for (; i < d->held_index; ++i)
+        fixed_write_block(d, i, 0);
+    d->has_before_zeroes = false;
+    d->zeroes = 0;
+}
+
+static void
+fixed_flush(struct FixedDigits d[static 1])
+{
+    fixed_flush_zeroes(d);
+    fixed_write_block(d, d->held_index, d->held);
+    for (size_t i = d->held_index + 1; i < d->count; ++i)
+        fixed_write_block(d, i, 999999999);
+    d->nines = 0;
+}
+
+static inline void
+fixed_push(struct FixedDigits d[static 1], const uint32_t block)
+{
+    if (d->count == 0)
+    {
+        d->held = block;
+    }
+    else if (block == 999999999)
+    {
+        d->nines++;
+    }
+    else if (block == 0 && d->nines == 0 && d->held_index >= d->integer_blocks)
+    {
+        if (d->held == 0) {
+            d->zeroes++;
+        } else {
+            d->before_zeroes = d->held;
+            d->has_before_zeroes = true;
+            d->held = 0;
+        }
+        d->held_index = d->count;
+    }
+    else
+    {
+        fixed_flush(d);
+        d->held = block;
+        d->held_index = d->count;
+    }
+    d->count++;
+}
+
+PF_TARGET_CLONES
+static unsigned
+write_fixed(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const double d)
+{
+    const size_t original_length = out->length;
+    const bool fmt_is_g =
+        fmt.conversion_format == 'g' || fmt.conversion_format == 'G';
+    unsigned precision;
+    if (fmt.precision.option == PF_SOME)
+        precision = fmt.precision.width;
+    else
+        precision = 6;
+    if (fmt_is_g && precision == 0) // significant digits
+        precision = 1;
+
+    const uint64_t bits = double_to_bits(d);
+
+    // Decode bits into sign, mantissa, and exponent.
+    const bool ieeeSign =
+        ((bits >> (DOUBLE_MANTISSA_BITS + DOUBLE_EXPONENT_BITS)) & 1) != 0;
+    const uint64_t ieeeMantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
+    const uint32_t ieeeExponent = (uint32_t)
+        ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+
+    if (ieeeSign)
+        push_char(out, '-');
+    else if (fmt.flag.plus)
+        push_char(out, '+');
+    else if (fmt.flag.space)
+        push_char(out, ' ');
+
+    // Case distinction; exit early for the easy cases.
+    if (ieeeExponent == ((1u << DOUBLE_EXPONENT_BITS) - 1u))
+    {
+        const bool uppercase =
+            fmt.conversion_format == 'F' || fmt.conversion_format == 'G';
+        pf_copy_special_str_printf(out, ieeeMantissa, uppercase);
+        return out->length - original_length;
+    }
+
+    if (ieeeExponent == 0 && ieeeMantissa == 0) // d == 0.0
+    {
+        push_char(out, '0');
+
+        if (precision > 0 || fmt.flag.hash)
+            push_char(out, '.');
+        pad(out, '0', precision);
+
+        if (capacity_left(*out))
+            *end(*out) = '\0';
+        return out->length - original_length;
+    }
+
+    int32_t e2;
+    uint64_t m2;
+    if (ieeeExponent == 0)
+    {
+        e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS;
+        m2 = ieeeMantissa;
+    }
+    else
+    {
+        e2 = (int32_t) ieeeExponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS;
+        m2 = (1ull << DOUBLE_MANTISSA_BITS) | ieeeMantissa;
+    }
+
+    PFFormatSpecifier small_fmt = fmt; // tests may leave conversion unset
+    if (small_fmt.conversion_format != 'F')
+        small_fmt.conversion_format = 'f';
+    if ( ! fmt_is_g && write_small_double(out, small_fmt, m2, e2))
+    {
+        if (capacity_left(*out))
+            *end(*out) = '\0';
+        return out->length - original_length;
+    }
+
+    bool is_zero = true; // for now
+
+    struct FixedDigits digits = { .out = out, .integer_blocks = SIZE_MAX };
+    uint32_t first_block = 0;
 
-    if (e2 >= -52) // store integer part
+    if (e2 >= -52) // integer part
     {
         const uint32_t idx = e2 < 0 ? 0 : indexForExponent((uint32_t) e2);
         const uint32_t p10bits = pow10BitsForIndex(idx);
         const int32_t len = (int32_t)lengthForIndex(idx);
+        uint64_t scratch[3]; // for pow10_split()
 
         for (int32_t i = len - 1; i >= 0; --i)
         {
             const uint32_t j = p10bits - e2;
-            const uint32_t digits = mulShift_mod1e9(
-                m2 << 8, POW10_SPLIT[POW10_OFFSET[idx] + i], (int32_t) (j + 8));
+            const uint32_t block = mulShift_mod1e9(
+                m2 << 8, pow10_split(idx, i, scratch), (int32_t) (j + 8));
 
-            if ( ! is_zero)
-            { // always subsequent iterations of loop
-                all_digits[digits_length++] = digits;
-            }
-            else if (digits != 0)
+            if (is_zero && block != 0)
             { // always 1st iteration of loop
-                all_digits[digits_length++] = digits;
+                first_block = block;
                 is_zero = false;
             }
+            if ( ! is_zero)
+                fixed_push(&digits, block);
         }
-        integer_part_end = digits_length;
     }
 
     if (is_zero)
     {
-        all_digits[0]    = 0;
-        digits_length    = 1;
-        integer_part_end = 1;
+        fixed_push(&digits, 0);
     }
     else if (fmt_is_g)
     {
-        const uint32_t significant_digits = decimalLength9(all_digits[0]) +
-            9*(integer_part_end - 1);
+        const uint32_t significant_digits = decimalLength9(first_block) +
+            9*(digits.count - 1);
 
         if (significant_digits >= precision)
             precision = 0;
         else
             precision -= significant_digits;
     }
+    digits.integer_blocks = digits.count;
 
     bool round_up = false;
-    uint32_t lastDigit = 0; // to be cut off. Determines roundUp.
-    uint32_t last_digit_magnitude = 1000*1000*1000;
-    uint32_t maximum = 9;
-    unsigned fract_leading_zeroes = 0;
-    unsigned fract_trailing_zeroes = 0;
+    bool has_last = false; // last block, cut to maximum digits, not pushed
+    uint32_t last = 0;
+    uint32_t maximum = 0;
+    uint32_t last_digit_magnitude = 1;
+    unsigned fract_trailing_zeroes = precision; // digits that are exactly zero
 
-    // Might have to update precision with 'g' and recalculate, thus loop
-    bool first_try = true;
-    while (e2 < 0) // store fractional part
+    if (e2 < 0) // fractional part
     {
         const int32_t idx = -e2 / 16;
-        const uint32_t blocks = precision / 9 + 1;
-
-        uint32_t i = 0;
-        if (blocks <= MIN_BLOCK_2[idx])
-        {
-            i = blocks; // skip the for-loop below
-            fract_leading_zeroes = precision;
-        }
-        else if (i < MIN_BLOCK_2[idx])
-        {
-            i = MIN_BLOCK_2[idx];
-            fract_leading_zeroes = 9 * i;
-        }
-
-        uint32_t digits = 0;
-        for (; i < blocks; ++i) // store significant fractional digits
-        {
-            const int32_t j = ADDITIONAL_BITS_2 + (-e2 - 16 * idx);
-            const uint32_t p = POW10_OFFSET_2[idx] + i - MIN_BLOCK_2[idx];
-
-            if (p >= POW10_OFFSET_2[idx + 1])
-            {
-                fract_trailing_zeroes = precision - 9 * i;
-                break;
-            }
-
-            digits = mulShift_mod1e9(m2 << 8, POW10_SPLIT_2[p], j + 8);
-            all_digits[digits_length++] = digits;
-        }
+        const int32_t j = ADDITIONAL_BITS_2 + (-e2 - 16 * idx);
+        uint64_t scratch[3]; // for pow10_split_2()
 
-        if (fmt_is_g && is_zero && first_try)
+        if (fmt_is_g && is_zero) // precision excludes leading zeroes
         {
-            uint32_t total_leading_zeroes = fract_leading_zeroes;
-
-            size_t i;
-            for (i = integer_part_end; i < digits_length - 1; i++)
+            for (uint32_t i = MIN_BLOCK_2[idx]; ; ++i)
             {
-                if (all_digits[i] == 0)
-                    total_leading_zeroes += 9;
-                else break;
-            }
-            total_leading_zeroes += 9 - decimalLength9(all_digits[i]);
+                const uint32_t p = POW10_OFFSET_2[idx] + i - MIN_BLOCK_2[idx];
+                if (p >= POW10_OFFSET_2[idx + 1])
+                    break;
 
-            if (total_leading_zeroes > 0)
-            {
-                precision += total_leading_zeroes;
-                digits_length = integer_part_end; // reset all_digits[]
-                first_try = false;
-                continue; // try again
+                const uint32_t block = mulShift_mod1e9(
+                    m2 << 8, pow10_split_2(idx, p, scratch), j + 8);
+                if (block != 0)
+                {
+                    precision += 9 * i + 9 - decimalLength9(block);
+                    break;
+                }
             }
+            fract_trailing_zeroes = precision;
         }
 
-        if (i == blocks)
+        const uint32_t blocks = precision / 9 + 1;
+        if (blocks > MIN_BLOCK_2[idx]) // else rounds to zero
         {
-            maximum = precision - 9 * (i - 1);
+            uint32_t i;
+            for (i = 0; i < MIN_BLOCK_2[idx]; ++i)
+                fixed_push(&digits, 0);
 
-            uint32_t k;
-            for (k = 0; k < 9 - maximum; ++k) // trim digits from right
-            {
-                lastDigit = digits % 10;
-                digits /= 10;
-            }
-            const uint32_t magnitude_table[] = { // avoid work in loop
-                1000000000,
-                100000000,
-                10000000,
-                1000000,
-                100000,
-                10000,
-                1000,
-                100,
-                10,
-                1
-            };
-            last_digit_magnitude = magnitude_table[k];
-
-            if (lastDigit != 5)
-            {
-                round_up = lastDigit > 5;
-            }
-            else
+            for (; i < blocks; ++i)
             {
-                const bool any_left_in_digits = k < 9;
-                const uint32_t next_digit = any_left_in_digits ?
-                    digits : all_digits[digits_length - 2];
-
-                const int32_t requiredTwos = -e2 - (int32_t) precision - 1;
-                const bool trailingZeros = requiredTwos <= 0 || (
-                    requiredTwos < 60 &&
-                    multipleOfPowerOf2(m2, (uint32_t)requiredTwos)
-                );
+                const uint32_t p = POW10_OFFSET_2[idx] + i - MIN_BLOCK_2[idx];
+                if (p >= POW10_OFFSET_2[idx + 1])
+                    break;
 
-                round_up = next_digit % 2 || ! trailingZeros;
+                const uint32_t block = mulShift_mod1e9(
+                    m2 << 8, pow10_split_2(idx, p, scratch), j + 8);
+                if (i < blocks - 1)
+                    fixed_push(&digits, block);
+                else
+                    last = block;
             }
-
-            if (digits_length != integer_part_end) // update modified digits
-                all_digits[digits_length - 1] = digits;
-            else // digits never stored, nowhere to round
-                round_up = false;
+            has_last = i == blocks;
+            fract_trailing_zeroes = has_last ? 0 : precision - 9 * i;
         }
-
-        break;
     }
 
-    if (round_up)
+    if (has_last)
     {
-        uint32_t last_real_mag = 0;
-        if (fmt_is_g && is_zero)
-            last_real_mag = decimalLength9(all_digits[1]);
-
-        all_digits[digits_length - 1] += 1;
+        maximum = precision % 9;
 
-        if (all_digits[digits_length - 1] == last_digit_magnitude)
-            all_digits[digits_length - 1] = 0; // carry 1
-        else
-            round_up = false;
+        // Trim digits from right
+        const uint32_t k = 9 - maximum;
+        const uint32_t rest = last / (uint32_t)POW10_UINT64[k - 1];
+        const uint32_t lastDigit = rest % 10; // to be cut off. Determines roundUp.
+        last = rest / 10;
+        last_digit_magnitude = (uint32_t)POW10_UINT64[9 - k];
 
-        if (round_up)
+        if (lastDigit != 5)
         {
-            for (size_t i = digits_length - 2; i > 0; i--) // keep rounding
-            {
-                all_digits[i] += 1;
-                if (all_digits[i] == (uint32_t)1000*1000*1000) {
-                    all_digits[i] = 0; // carry 1
-                } else {
-                    round_up = false;
-                    break;
-                }
-            }
+            round_up = lastDigit > 5;
         }
-
-        if (round_up)
-            all_digits[0] += 1;
-
-        if (fmt_is_g && is_zero)
+        else
         {
-            if (round_up) { // 0.xxx turned to 1.xxx
-                maximum--;
-            } else if (decimalLength9(all_digits[1]) > last_real_mag) {
-                maximum--;
-                all_digits[1] /= 10;
-            }
+            const bool any_left_in_digits = k < 9;
+            const uint32_t previous_block = digits.nines != 0 ?
+                999999999 : digits.held;
+            const uint32_t next_digit = any_left_in_digits ?
+                last : previous_block;
+
+            const int32_t requiredTwos = -e2 - (int32_t) precision - 1;
+            const bool trailingZeros = requiredTwos <= 0 || (
+                requiredTwos < 60 &&
+                multipleOfPowerOf2(m2, (uint32_t)requiredTwos)
+            );
+
+            round_up = next_digit % 2 || ! trailingZeros;
         }
     }
 
-    // Start writing digits for integer part
-
-    append_utoa(&out, all_digits[0]);
-
-    for (size_t i = 1; i < integer_part_end; i++)
+    // With 'g', rounding 0.0999 to 0.1000 or 9.99 to 10.00 adds a significant
+    // digit, so one has to be dropped from the end.
+    bool carry = false;
+    bool drop_digit = false;
+    if (round_up)
     {
-        pf_append_nine_digits(&out, all_digits[i]);
+        if (last + 1 == last_digit_magnitude)
+        {
+            const bool longer = digits.held == 999999999 ||
+                decimalLength9(digits.held + 1) > decimalLength9(digits.held);
+            if (fmt_is_g && digits.held_index == 0)
+                drop_digit = is_zero || longer;
+            else if (fmt_is_g && is_zero)
+                drop_digit = digits.held_index == digits.integer_blocks && longer;
+
+            last = 0;
+            digits.held += 1;
+            carry = true;
+        }
+        else
+        {
+            if (fmt_is_g && is_zero && digits.count == digits.integer_blocks)
+                drop_digit = decimalLength9(last + 1) > decimalLength9(last);
+            last += 1;
+        }
     }
 
-    // Start writing digits for fractional part
+    // Write held digits. After carry, the held nines are zeroes.
 
+    const uint32_t nines = carry ? 0 : 999999999;
     if ( ! fmt_is_g || fmt.flag.hash)
     {
-        if (precision > 0 || fmt.flag.hash)
-            push_char(&out, '.');
+        fixed_flush_zeroes(&digits);
+        const bool drop_from_held = drop_digit && maximum == 0 &&
+            digits.nines == 0 && digits.held_index >= digits.integer_blocks;
+        if (drop_from_held) {
+            fixed_point(&digits);
+            pf_append_c_digits(out, 8, digits.held / 10);
+        } else {
+            fixed_write_block(&digits, digits.held_index, digits.held);
+        }
 
-        if (digits_length != integer_part_end)
+        for (size_t i = digits.held_index + 1; i < digits.count; ++i)
         {
-            pad(&out, '0', fract_leading_zeroes);
-
-            for (size_t k = integer_part_end; k < digits_length - 1; k++)
-                pf_append_nine_digits(&out, all_digits[k]);
-
-            if (maximum > 0) // write the last digits left
-                pf_append_c_digits(&out, maximum, all_digits[digits_length - 1]);
+            if (drop_digit && maximum == 0 && i == digits.count - 1 &&
+                i >= digits.integer_blocks) {
+                fixed_point(&digits);
+                pf_append_c_digits(out, 8, nines / 10);
+            } else {
+                fixed_write_block(&digits, i, nines);
+            }
+        }
 
-            pad(&out, '0', fract_trailing_zeroes);
+        if (drop_digit && maximum > 0)
+        {
+            maximum--;
+            last /= 10;
         }
-        else
+        if (maximum > 0) // write the last digits left
         {
-            pad(&out, '0', precision);
+            fixed_point(&digits);
+            pf_append_c_digits(out, maximum, last);
         }
+
+        if (precision > 0 || fmt.flag.hash)
+            fixed_point(&digits);
+        pad(out, '0', fract_trailing_zeroes);
     }
-    else
+    else // trim trailing zeroes
     {
-        // Trim trailing zeroes
-        while (digits_length != integer_part_end)
+        if (maximum > 0 && last != 0)
         {
-            if (all_digits[digits_length - 1] == 0)
-            {
-                digits_length--;
-                maximum = 9;
-                continue;
-            }
-            else
+            fixed_flush(&digits);
+            while (last % 10 == 0)
             {
-                while (all_digits[digits_length - 1] != 0)
-                {
-                    if (all_digits[digits_length - 1] % 10 == 0) {
-                        all_digits[digits_length - 1] /= 10;
-                        maximum--;
-                    } else
-                        goto end_trim_zeroes;
-                }
+                last /= 10;
+                maximum--;
             }
-        } end_trim_zeroes:
-
-        if (digits_length > integer_part_end)
+            fixed_point(&digits);
+            pf_append_c_digits(out, maximum, last);
+        }
+        else if (digits.nines != 0 && ! carry)
         {
-            push_char(&out, '.');
-            pad(&out, '0', fract_leading_zeroes);
-
-            for (size_t k = integer_part_end; k < digits_length - 1; k++)
-                pf_append_nine_digits(&out, all_digits[k]);
-
-            pf_append_c_digits(&out, maximum, all_digits[digits_length - 1]);
+            fixed_flush(&digits);
+        }
+        else if (digits.held_index < digits.integer_blocks)
+        { // carried nines of integer part are zeroes, but not trailing ones
+            fixed_write_block(&digits, digits.held_index, digits.held);
+            for (size_t i = digits.held_index + 1;
+                i < digits.count && i < digits.integer_blocks; ++i)
+                fixed_write_block(&digits, i, 0);
+        }
+        else if (digits.held != 0)
+        {
+            fixed_flush_zeroes(&digits);
+            fixed_write_trimmed(&digits, digits.held);
+        }
+        else if (digits.has_before_zeroes)
+        {
+            fixed_write_trimmed(&digits, digits.before_zeroes);
         }
     }
 
-    if (capacity_left(out))
-        out.data[out.length] = '\0';
-    return out.length;
+    if (capacity_left(*out))
+        *end(*out) = '\0';
+    return out->length - original_length;
 }
 
+PF_TARGET_CLONES
 static unsigned
-pf_d2exp_buffered_n(
-    char* const result,
-    const size_t n,
+write_exp(
+    struct PFString out[static 1],
     const PFFormatSpecifier fmt,
     const double d)
 {
-    struct PFString out = { result, .capacity = n };
+    const size_t original_length = out->length;
     const bool fmt_is_g =
         fmt.conversion_format == 'g' || fmt.conversion_format == 'G';
 
@@ -890,43 +1601,44 @@ pf_d2exp_buffered_n(
         ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
 
     if (ieeeSign)
-        push_char(&out, '-');
+        push_char(out, '-');
     else if (fmt.flag.plus)
-        push_char(&out, '+');
+        push_char(out, '+');
     else if (fmt.flag.space)
-        push_char(&out, ' ');
+        push_char(out, ' ');
 
     // Case distinction; exit early for the easy cases.
     if (ieeeExponent == ((1u << DOUBLE_EXPONENT_BITS) - 1u))
     {
         const bool uppercase =
             fmt.conversion_format == 'E' || fmt.conversion_format == 'G';
-        return pf_copy_special_str_printf(&out, ieeeMantissa, uppercase);
+        pf_copy_special_str_printf(out, ieeeMantissa, uppercase);
+        return out->length - original_length;
     }
 
     if (ieeeExponent == 0 && ieeeMantissa == 0) // d = 0.0
     {
-        push_char(&out, '0');
+        push_char(out, '0');
         if (fmt_is_g && ! fmt.flag.hash) {
-            if (capacity_left(out))
-                out.data[out.length] = '\0';
-            return out.length;
+            if (capacity_left(*out))
+                *end(*out) = '\0';
+            return out->length - original_length;
         }
 
         if (precision > 0 || fmt.flag.hash)
         {
-            push_char(&out, '.');
-            pad(&out, '0', precision);
+            push_char(out, '.');
+            pad(out, '0', precision);
         }
 
         if (fmt.conversion_format == 'e')
-            concat(&out, "e+00", strlen("e+00"));
+            concat(out, "e+00", strlen("e+00"));
         else if (fmt.conversion_format == 'E')
-            concat(&out, "E+00", strlen("E+00"));
+            concat(out, "E+00", strlen("E+00"));
 
-        if (capacity_left(out))
-            out.data[out.length] = '\0';
-        return out.length;
+        if (capacity_left(*out))
+            *end(*out) = '\0';
+        return out->length - original_length;
     }
 
     int32_t e2;
@@ -939,6 +1651,16 @@ pf_d2exp_buffered_n(
         m2 = (1ull << DOUBLE_MANTISSA_BITS) | ieeeMantissa;
     }
 
+    PFFormatSpecifier small_fmt = fmt; // tests may leave conversion unset
+    if ( ! fmt_is_g && small_fmt.conversion_format != 'E')
+        small_fmt.conversion_format = 'e';
+    if (write_small_double(out, small_fmt, m2, e2))
+    {
+        if (capacity_left(*out))
+            *end(*out) = '\0';
+        return out->length - original_length;
+    }
+
     const bool printDecimalPoint = precision > 0;
     ++precision;
 
@@ -947,7 +1669,7 @@ pf_d2exp_buffered_n(
     uint32_t availableDigits = 0;
     int32_t exp = 0;
 
-    uint32_t all_digits[256] = {}; // significant digits without trailing zeroes
+    uint32_t all_digits[256]; // significant digits without trailing zeroes
     size_t digits_length = 0;
     uint32_t first_available_digits = 0;
 
@@ -956,6 +1678,7 @@ pf_d2exp_buffered_n(
         const uint32_t idx = e2 < 0 ? 0 : indexForExponent((uint32_t)e2);
         const uint32_t p10bits = pow10BitsForIndex(idx);
         const int32_t len = (int32_t)lengthForIndex(idx);
+        uint64_t scratch[3]; // for pow10_split()
         for (int32_t i = len - 1; i >= 0; --i)
         {
             const uint32_t j = p10bits - e2;
@@ -963,7 +1686,7 @@ pf_d2exp_buffered_n(
             // push it to 128 or above, which is a slightly faster code path in
             // mulShift_mod1e9. Instead, we can just increase the multipliers.
             digits = mulShift_mod1e9(
-                m2 << 8, POW10_SPLIT[POW10_OFFSET[idx] + i], (int32_t)(j + 8));
+                m2 << 8, pow10_split(idx, i, scratch), (int32_t)(j + 8));
 
             if (stored_digits != 0) // never first iteration
             { // store fractional part excluding last max 9 digits
@@ -998,6 +1721,7 @@ pf_d2exp_buffered_n(
     if (e2 < 0 && availableDigits == 0)
     {
         const int32_t idx = -e2 / 16;
+        uint64_t scratch[3]; // for pow10_split_2()
 
         for (int32_t i = MIN_BLOCK_2[idx]; i < 200; ++i)
         {
@@ -1007,7 +1731,7 @@ pf_d2exp_buffered_n(
             // push it to 128 or above, which is a slightly faster code path in
             // mulShift_mod1e9. Instead, we can just increase the multipliers.
             digits = (p >= POW10_OFFSET_2[idx + 1]) ?
-                0 : mulShift_mod1e9(m2 << 8, POW10_SPLIT_2[p], j + 8);
+                0 : mulShift_mod1e9(m2 << 8, pow10_split_2(idx, p, scratch), j + 8);
 
             if (stored_digits != 0) // never first iteration
             { // store fractional part excluding last max 9 digits
@@ -1048,25 +1772,12 @@ pf_d2exp_buffered_n(
     uint32_t k = 0;
     if (availableDigits > maximum) // find last digit
     {
-        for (k = 0; k < availableDigits - maximum; ++k)
-        {
-            lastDigit = digits % 10;
-            digits /= 10;
-        }
+        k = availableDigits - maximum;
+        const uint32_t rest = digits / (uint32_t)POW10_UINT64[k - 1];
+        lastDigit = rest % 10;
+        digits = rest / 10;
     }
-    const uint32_t magnitude_table[] = { // avoid work in loop
-        1000000000,
-        100000000,
-        10000000,
-        1000000,
-        100000,
-        10000,
-        1000,
-        100,
-        10,
-        1
-    };
-    const uint32_t last_digit_magnitude = magnitude_table[k];
+    const uint32_t last_digit_magnitude = (uint32_t)POW10_UINT64[9 - k];
 
     all_digits[digits_length++] = digits;
 
@@ -1121,7 +1832,7 @@ pf_d2exp_buffered_n(
         if (round_up)
         {
             all_digits[0] += 1;
-            if (all_digits[0] == magnitude_table[9 - first_available_digits])
+            if (all_digits[0] == POW10_UINT64[first_available_digits])
             {
                 all_digits[0] /= 10;
                 ++exp;
@@ -1132,7 +1843,7 @@ pf_d2exp_buffered_n(
     {
         all_digits[0] += 1;
         if (all_digits[0] ==
-                last_digit_magnitude / magnitude_table[first_available_digits])
+                last_digit_magnitude / POW10_UINT64[9 - first_available_digits])
         {
             exp++;
         }
@@ -1140,33 +1851,36 @@ pf_d2exp_buffered_n(
 
     // Exponent is known now and we can determine the appropriate 'g' conversion
     if (fmt_is_g && ! (exp < -4 || exp >= (int32_t)precision))
-        return pf_d2fixed_buffered_n(result, n, fmt, d);
+    { // discard sign, write_fixed() writes it again
+        out->length = original_length;
+        return write_fixed(out, fmt, d);
+    }
 
     if ( ! printDecimalPoint)
     {
         if (all_digits[0] == 10) // rounded up from 9
             all_digits[0] = 1;
-        push_char(&out, '0' + all_digits[0]);
+        push_char(out, '0' + all_digits[0]);
         if (fmt.flag.hash)
-            push_char(&out, '.');
+            push_char(out, '.');
     }
     else if ( ! fmt_is_g || fmt.flag.hash)
     {
         if (stored_digits != 0)
         {
-            pf_append_d_digits(&out, first_available_digits, all_digits[0]);
+            pf_append_d_digits(out, first_available_digits, all_digits[0]);
 
             for (size_t i = 1; i < digits_length - 1; i++)
-                pf_append_nine_digits(&out, all_digits[i]);
+                pf_append_nine_digits(out, all_digits[i]);
 
             if (all_digits[digits_length - 1] == 0)
-                pad(&out, '0', maximum);
+                pad(out, '0', maximum);
             else
-                pf_append_c_digits(&out, maximum, all_digits[digits_length - 1]);
+                pf_append_c_digits(out, maximum, all_digits[digits_length - 1]);
         }
         else
         {
-            pf_append_d_digits(&out, maximum, all_digits[0]);
+            pf_append_d_digits(out, maximum, all_digits[0]);
         }
     }
     else // 'g'
@@ -1196,33 +1910,33 @@ pf_d2exp_buffered_n(
 
         if (digits_length > 1)
         {
-            pf_append_d_digits(&out, first_available_digits, all_digits[0]);
+            pf_append_d_digits(out, first_available_digits, all_digits[0]);
 
             for (size_t i = 1; i < digits_length - 1; i++)
-                pf_append_nine_digits(&out, all_digits[i]);
+                pf_append_nine_digits(out, all_digits[i]);
 
             if (all_digits[digits_length - 1] != 0)
                 pf_append_c_digits(
-                    &out, last_digits_length, all_digits[digits_length - 1]);
+                    out, last_digits_length, all_digits[digits_length - 1]);
         }
         else
         {
             if (all_digits[0] >= 10)
                 pf_append_d_digits(
-                    &out, decimalLength9(all_digits[0]), all_digits[0]);
+                    out, decimalLength9(all_digits[0]), all_digits[0]);
             else
-                push_char(&out, '0' + all_digits[0]);
+                push_char(out, '0' + all_digits[0]);
         }
     }
 
     const bool uppercase =
         fmt.conversion_format == 'E' || fmt.conversion_format == 'G';
-    push_char(&out, uppercase ? 'E' : 'e');
+    push_char(out, uppercase ? 'E' : 'e');
     if (exp < 0) {
-        push_char(&out, '-');
+        push_char(out, '-');
         exp = -exp;
     } else {
-        push_char(&out, '+');
+        push_char(out, '+');
     }
 
     char buf[4] = "";
@@ -1233,9 +1947,1023 @@ pf_d2exp_buffered_n(
     } else {
         memcpy(buf, DIGIT_TABLE + 2 * exp, 2);
     }
-    concat(&out, buf, strlen(buf));
+    concat(out, buf, strlen(buf));
+
+    if (capacity_left(*out))
+        *end(*out) = '\0';
+    return out->length - original_length;
+}
+
+static void
+append_exponent(struct PFString out[static 1], int32_t exp, const bool uppercase)
+{
+    push_char(out, uppercase ? 'E' : 'e');
+    push_char(out, exp < 0 ? '-' : '+');
+    exp = exp < 0 ? -exp : exp;
+    char buf[5] = ""; // long double exponents have up to 4 digits
+    if (exp >= 1000) {
+        memcpy(buf, DIGIT_TABLE + 2 * (exp / 100), 2);
+        memcpy(buf + 2, DIGIT_TABLE + 2 * (exp % 100), 2);
+    } else if (exp >= 100) {
+        memcpy(buf, DIGIT_TABLE + 2 * (exp / 10), 2);
+        buf[2] = '0' + exp % 10;
+    } else {
+        memcpy(buf, DIGIT_TABLE + 2 * exp, 2);
+    }
+    concat(out, buf, strlen(buf));
+}
+
+// Write olength digits with decimal exponent exp of the first digit like "%g"
+// would with precision of max_digits, but without trailing zeroes.
+static void
+append_shortest(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const char digits[static 1],
+    const unsigned olength,
+    const int32_t exp,
+    const int32_t max_digits)
+{
+    if (exp < -4 || exp >= max_digits) // exponential notation
+    {
+        push_char(out, digits[0]);
+        if (olength > 1 || fmt.flag.hash)
+            push_char(out, '.');
+        concat(out, digits + 1, olength - 1);
+        append_exponent(out, exp, fmt.conversion_format == 'R');
+    }
+    else if (exp < 0) // 0.000ddd
+    {
+        concat(out, "0.", strlen("0."));
+        pad(out, '0', -exp - 1);
+        concat(out, digits, olength);
+    }
+    else if ((unsigned)exp + 1 >= olength) // ddd000
+    {
+        concat(out, digits, olength);
+        pad(out, '0', exp + 1 - olength);
+        if (fmt.flag.hash)
+            push_char(out, '.');
+    }
+    else // ddd.ddd
+    {
+        concat(out, digits, exp + 1);
+        push_char(out, '.');
+        concat(out, digits + exp + 1, olength - exp - 1);
+    }
+}
+
+// Digits come from Ryū d2s, which are formatted here like "%g" would with
+// precision of 17. Precision of fmt is ignored.
+static unsigned
+write_shortest(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const double d)
+{
+    const size_t original_length = out->length;
+    const bool uppercase = fmt.conversion_format == 'R';
+    const uint64_t bits = double_to_bits(d);
+
+    // Decode bits into sign, mantissa, and exponent.
+    const bool ieeeSign =
+        ((bits >> (DOUBLE_MANTISSA_BITS + DOUBLE_EXPONENT_BITS)) & 1) != 0;
+    const uint64_t ieeeMantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
+    const uint32_t ieeeExponent = (uint32_t)
+        ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+
+    if (ieeeSign)
+        push_char(out, '-');
+    else if (fmt.flag.plus)
+        push_char(out, '+');
+    else if (fmt.flag.space)
+        push_char(out, ' ');
+
+    if (ieeeExponent == ((1u << DOUBLE_EXPONENT_BITS) - 1u))
+    {
+        pf_copy_special_str_printf(out, ieeeMantissa, uppercase);
+        return out->length - original_length;
+    }
+
+    char digits[20];
+    unsigned olength = 1;
+    int32_t exp = 0; // of the first digit
+    if (ieeeExponent == 0 && ieeeMantissa == 0)
+    {
+        digits[0] = '0';
+    }
+    else
+    {
+        uint64_t mantissa;
+        int32_t exponent;
+        d2s_decimal(d, &mantissa, &exponent);
+        olength = append_u64_digits(mantissa, digits);
+        exp = exponent + (int32_t)olength - 1;
+    }
+
+    append_shortest(out, fmt, digits, olength, exp, 17);
+
+    if (capacity_left(*out))
+        *end(*out) = '\0';
+    return out->length - original_length;
+}
+
+// ---------------------------------------------------------------------------
+//
+// Hexadecimal floating point
+//
+// Hexadecimal digits are the mantissa bits as is, so "%a" needs no tables or
+// multiplication. Rounding to precision is done by adding to the kept digits
+// and digits are written two at a time from the hexadecimal pair tables.
+//
+// ---------------------------------------------------------------------------
+
+// Write leading.fraction * 2^exp, where fraction has fraction_digits < 16
+// hexadecimal digits and leading is a single digit. Zeroes are inserted after
+// "0x" to fill field width if fmt.flag.zero, unlike with other conversions.
+static unsigned
+append_hex_float(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const bool negative,
+    uint64_t leading,
+    uint64_t fraction,
+    unsigned fraction_digits,
+    int32_t exp)
+{
+    const size_t original_length = out->length;
+    const bool uppercase = fmt.conversion_format == 'A';
+    const char* const table = uppercase ? HEX_TABLE_UPPER : HEX_TABLE_LOWER;
+
+    unsigned padding = 0; // zeroes past the digits of fraction
+    if (fmt.precision.option != PF_SOME) // exact, trim trailing zeroes
+    {
+        const unsigned zeroes =
+            fraction == 0 ? fraction_digits : (unsigned)__builtin_ctzll(fraction) / 4;
+        fraction >>= 4 * zeroes;
+        fraction_digits -= zeroes;
+    }
+    else if (fmt.precision.width < fraction_digits) // round to nearest even
+    {
+        const unsigned precision = fmt.precision.width;
+        const unsigned shift     = 4 * (fraction_digits - precision);
+        const uint64_t half      = (uint64_t)1 << (shift - 1);
+        const uint64_t dropped   = fraction & ((half << 1) - 1);
+        uint64_t kept = (leading << 4 * fraction_digits | fraction) >> shift;
+        kept += dropped > half || (dropped == half && (kept & 1));
+        leading  = kept >> 4 * precision;
+        fraction = kept & (((uint64_t)1 << 4 * precision) - 1);
+        fraction_digits = precision;
+        if (leading == 0x10) { // 0xf.f to 0x1.0 like glibc, 0x1.f goes to 0x2.0
+            leading = 1;
+            exp += 4;
+        }
+    }
+    else
+        padding = fmt.precision.width - fraction_digits;
+
+    const unsigned abs_exp = exp < 0 ? -(unsigned)exp : (unsigned)exp;
+    const unsigned exp_length = decimalLength9(abs_exp);
+    const bool point = fraction_digits + padding > 0 || fmt.flag.hash;
+    const bool sign  = negative || fmt.flag.plus || fmt.flag.space;
+    const unsigned length = sign + strlen("0x") + 1 + point +
+        fraction_digits + padding + strlen("p+") + exp_length;
+
+    if (negative)
+        push_char(out, '-');
+    else if (fmt.flag.plus)
+        push_char(out, '+');
+    else if (fmt.flag.space)
+        push_char(out, ' ');
+    concat(out, uppercase ? "0X" : "0x", strlen("0x"));
+    if (fmt.flag.zero && ! fmt.flag.dash && fmt.field.width > length)
+        pad(out, '0', fmt.field.width - length);
+
+    push_char(out, table[2 * leading + 1]);
+    if (point)
+        push_char(out, '.');
+
+    // Fraction left aligned, written in pairs
+    char digits[16];
+    uint64_t x = fraction_digits > 0 ? fraction << (64 - 4 * fraction_digits) : 0;
+    for (unsigned i = 0; i < fraction_digits; i += 2, x <<= 8)
+        memcpy(digits + i, table + 2 * (x >> 56), 2);
+    concat(out, digits, fraction_digits);
+    pad(out, '0', padding);
+
+    char exponent[2 + 10] = { uppercase ? 'P' : 'p', exp < 0 ? '-' : '+' };
+    append_n_digits(exp_length, abs_exp, exponent + 2);
+    concat(out, exponent, 2 + exp_length);
+
+    if (capacity_left(*out))
+        *end(*out) = '\0';
+    return out->length - original_length;
+}
+
+static unsigned
+write_hex(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const double d)
+{
+    const uint64_t bits = double_to_bits(d);
+
+    // Decode bits into sign, mantissa, and exponent.
+    const bool ieeeSign =
+        ((bits >> (DOUBLE_MANTISSA_BITS + DOUBLE_EXPONENT_BITS)) & 1) != 0;
+    const uint64_t ieeeMantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
+    const uint32_t ieeeExponent = (uint32_t)
+        ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+
+    if (ieeeExponent == ((1u << DOUBLE_EXPONENT_BITS) - 1u))
+    {
+        const size_t original_length = out->length;
+        if (ieeeSign)
+            push_char(out, '-');
+        else if (fmt.flag.plus)
+            push_char(out, '+');
+        else if (fmt.flag.space)
+            push_char(out, ' ');
+        pf_copy_special_str_printf(out, ieeeMantissa, fmt.conversion_format == 'A');
+        return out->length - original_length;
+    }
+
+    // Subnormals are written as 0x0.<fraction>p-1022 and zero as 0x0p+0.
+    const bool normal = ieeeExponent != 0;
+    const int32_t exp = normal ? (int32_t)ieeeExponent - DOUBLE_BIAS :
+        ieeeMantissa != 0 ? 1 - DOUBLE_BIAS : 0;
+    return append_hex_float(
+        out, fmt, ieeeSign, normal, ieeeMantissa, DOUBLE_MANTISSA_BITS / 4, exp);
+}
+
+// ---------------------------------------------------------------------------
+//
+// Single precision
+//
+// A float is m2 * 2^e2 with 24-bit m2, so its exact decimal expansion is short
+// enough to be generated directly with 32-bit limbs 9 digits at a time. This
+// needs no tables, unlike formatting floats as doubles with Ryū printf.
+//
+// ---------------------------------------------------------------------------
+
+#define FLOAT_MANTISSA_BITS 23
+#define FLOAT_EXPONENT_BITS 8
+#define FLOAT_BIAS 127
+
+// Exact value of a float has at most 112 significant digits. Leave room for
+// digits written 9 at a time past them.
+#define FLOAT_MAX_DIGITS 128
+
+// Divide integer in limbs below top to 9 digit chunks and write the digits to
+// result. Limbs are overwritten. chunks needs room for all chunks.
+static unsigned
+append_limbs_integer(
+    uint32_t limbs[static 1],
+    unsigned top,
+    uint32_t chunks[static 1],
+    char* const result)
+{
+    unsigned count = 0;
+    while (top > 0)
+    {
+        uint64_t remainder = 0;
+        for (unsigned i = top; i-- > 0;)
+        {
+            const uint64_t x = remainder << 32 | limbs[i];
+            limbs[i]  = (uint32_t)(x / 1000000000);
+            remainder = x % 1000000000;
+        }
+        chunks[count++] = (uint32_t)remainder;
+        while (top > 0 && limbs[top - 1] == 0)
+            top--;
+    }
+
+    unsigned length = decimalLength9(chunks[count - 1]);
+    append_n_digits(length, chunks[count - 1], result);
+    for (unsigned i = count - 1; i-- > 0;)
+    {
+        append_nine_digits(chunks[i], result + length);
+        length += 9;
+    }
+    return length;
+}
+
+// Integer m2 * 2^e2 >= 2^64 is divided to 9 digit chunks with 32-bit limbs.
+static unsigned
+append_float_integer(const uint32_t m2, const int32_t e2, char* const result)
+{
+    uint32_t limbs[5] = {0}; // least significant first
+    const uint64_t shifted = (uint64_t)m2 << (e2 % 32);
+    limbs[e2 / 32]     = (uint32_t)shifted;
+    limbs[e2 / 32 + 1] = (uint32_t)(shifted >> 32);
+
+    uint32_t chunks[5]; // 2^128 has 39 digits
+    return append_limbs_integer(limbs, e2 / 32 + 2, chunks, result);
+}
+
+// Multiply fraction with binary point above limbs[end - 1] by 10^9 and return
+// the integer part. Only limbs from *start to *high can be nonzero. Limbs from
+// the least significant that become zero are skipped by advancing *start and
+// *high grows with the fraction.
+static inline uint32_t
+fraction_next_nine_digits(
+    uint32_t limbs[static 1],
+    unsigned start[static 1],
+    unsigned high[static 1],
+    const unsigned end)
+{
+    uint64_t carry = 0;
+    for (unsigned i = *start; i < *high; i++)
+    {
+        const uint64_t x = (uint64_t)limbs[i] * 1000000000 + carry;
+        limbs[i] = (uint32_t)x;
+        carry    = x >> 32;
+    }
+    if (*high < end)
+    {
+        limbs[*high] = (uint32_t)carry;
+        *high += carry != 0;
+        carry = 0;
+    }
+    while (*start < *high && limbs[*start] == 0)
+        ++*start;
+    return (uint32_t)carry;
+}
+
+// Round length digits to keep digits to nearest with ties to even. any_left
+// tells if there are nonzero digits past length. Trailing zeroes are trimmed.
+// Zero is written as "0" with exponent 0. Returns the new length.
+static unsigned
+round_decimal(
+    char digits[static 1],
+    unsigned length,
+    const int64_t keep,
+    bool any_left,
+    int32_t exp[static 1])
+{
+    if ((int64_t)length > keep)
+    {
+        bool round_up = false;
+        if (keep >= 0)
+        {
+            const char dropped = digits[keep];
+            for (unsigned i = keep + 1; i < length && ! any_left; i++)
+                any_left = digits[i] != '0';
+            const bool odd = keep > 0 && (digits[keep - 1] - '0') % 2;
+            round_up = dropped > '5' || (dropped == '5' && (any_left || odd));
+        }
+        length = keep < 0 ? 0 : keep;
+
+        if (round_up)
+        {
+            int64_t i = (int64_t)length - 1;
+            while (i >= 0 && digits[i] == '9') // rounded to zeroes to be trimmed
+                i--;
+            if (i >= 0) {
+                digits[i]++;
+                length = i + 1;
+            } else { // 999 to 1000 or 0 to 1 at the last kept digit
+                digits[0] = '1';
+                length = 1;
+                ++*exp;
+            }
+        }
+    }
+
+    while (length > 0 && digits[length - 1] == '0')
+        length--;
+    if (length == 0)
+    {
+        digits[0] = '0';
+        length = 1;
+        *exp = 0;
+    }
+    return length;
+}
+
+// Append digits of fraction in limbs from fraction_next_nine_digits() to length
+// digits of integer part, and round them like float_to_decimal().
+static unsigned
+fraction_to_decimal(
+    uint32_t limbs[static 1],
+    unsigned start,
+    unsigned high,
+    const unsigned end,
+    const bool exp_notation,
+    const unsigned precision,
+    char digits[static 1],
+    unsigned length,
+    int32_t exp[static 1])
+{
+    while (start < high && limbs[start] == 0)
+        start++;
+
+    int64_t keep = INT64_MAX; // significant digits, known after the first one
+    if (length > 0)
+    {
+        *exp = (int32_t)length - 1;
+        keep = exp_notation ? (int64_t)precision + 1 : (int64_t)length + precision;
+    }
+
+    uint64_t position = 0; // fractional digits generated
+    while (start < high && (int64_t)length <= keep)
+    {
+        if (length == 0 && ! exp_notation && position > precision)
+            break; // value < 10^-(precision + 1), rounds to zero
+
+        const uint32_t chunk =
+            fraction_next_nine_digits(limbs, &start, &high, end);
+        position += 9;
+        if (length != 0)
+        {
+            append_nine_digits(chunk, digits + length);
+            length += 9;
+        }
+        else if (chunk != 0) // first significant digit
+        {
+            length = decimalLength9(chunk);
+            append_n_digits(length, chunk, digits);
+            *exp = (int32_t)length - 1 - (int32_t)position;
+            keep = exp_notation ?
+                (int64_t)precision + 1 : (int64_t)*exp + 1 + precision;
+        }
+    }
+
+    return round_decimal(digits, length, keep, start < high, exp);
+}
+
+// Decimal digits of m2 * 2^e2 rounded to nearest with ties to even. If
+// exp_notation, precision counts digits after the first one, otherwise after
+// the decimal point. Digits are written without trailing zeroes and *exp is
+// set to the decimal exponent of the first digit. Returns the number of digits.
+// Value that is or rounds to zero is written as "0" with exponent 0.
+static unsigned
+float_to_decimal(
+    const uint32_t m2,
+    const int32_t e2,
+    const bool exp_notation,
+    const unsigned precision,
+    char digits[static FLOAT_MAX_DIGITS],
+    int32_t exp[static 1])
+{
+    unsigned length = 0;
+    uint32_t fraction[5] = {0}; // least significant first
+    unsigned end = 0;
+
+    if (e2 > 40)
+    {
+        length = append_float_integer(m2, e2, digits);
+    }
+    else if (e2 >= 0)
+    {
+        length = append_u64_digits((uint64_t)m2 << e2, digits);
+    }
+    else if (e2 > -32)
+    {
+        const uint32_t integer = m2 >> -e2;
+        if (integer != 0)
+        {
+            length = decimalLength9(integer);
+            append_n_digits(length, integer, digits);
+        }
+        fraction[0] = m2 << (32 + e2);
+        end = 1;
+    }
+    else // shift binary point to a limb boundary
+    {
+        end = (31 - e2) / 32;
+        const uint64_t shifted = (uint64_t)m2 << (32 * end + e2);
+        fraction[0] = (uint32_t)shifted;
+        fraction[1] = (uint32_t)(shifted >> 32);
+    }
+    return fraction_to_decimal(
+        fraction, 0, end, end, exp_notation, precision, digits, length, exp);
+}
+
+// "%f" with digits from float_to_decimal() or long_double_to_decimal().
+// Fraction is not padded with zeroes to precision if trim.
+static void
+append_decimal_fixed(
+    struct PFString out[static 1],
+    const char digits[static 1],
+    const unsigned length,
+    const int32_t exp,
+    const unsigned precision,
+    const bool trim,
+    const bool hash)
+{
+    const unsigned integer_length = exp >= 0 ? (unsigned)exp + 1 : 0;
+    if (integer_length == 0)
+        push_char(out, '0');
+    else if (integer_length >= length) {
+        concat(out, digits, length);
+        pad(out, '0', integer_length - length);
+    } else
+        concat(out, digits, integer_length);
+
+    const unsigned leading_zeroes = exp < 0 ? (unsigned)-exp - 1 : 0;
+    const unsigned fraction_digits =
+        length > integer_length ? length - integer_length : 0;
+    const unsigned fraction_length = ! trim ? precision :
+        fraction_digits > 0 ? leading_zeroes + fraction_digits : 0;
+
+    if (fraction_length > 0 || hash)
+        push_char(out, '.');
+    if (fraction_length > 0)
+    {
+        pad(out, '0', leading_zeroes);
+        concat(out, digits + integer_length, fraction_digits);
+        pad(out, '0', fraction_length - leading_zeroes - fraction_digits);
+    }
+}
+
+// "%e" with digits from float_to_decimal() or long_double_to_decimal().
+// Fraction is not padded with zeroes to precision if trim.
+static void
+append_decimal_exp(
+    struct PFString out[static 1],
+    const char digits[static 1],
+    const unsigned length,
+    const int32_t exp,
+    const unsigned precision,
+    const bool trim,
+    const bool hash,
+    const bool uppercase)
+{
+    push_char(out, digits[0]);
+    const unsigned fraction_length = trim ? length - 1 : precision;
+    if (fraction_length > 0 || hash)
+        push_char(out, '.');
+    concat(out, digits + 1, length - 1);
+    pad(out, '0', fraction_length - (length - 1));
+    append_exponent(out, exp, uppercase);
+}
+
+// Precision for float_to_decimal() and long_double_to_decimal() and whether it
+// counts significant digits.
+static unsigned
+decimal_precision(const PFFormatSpecifier fmt, bool exp_notation[static 1])
+{
+    const unsigned char conversion = fmt.conversion_format;
+    const unsigned precision =
+        fmt.precision.option == PF_SOME ? fmt.precision.width : 6;
+    *exp_notation = conversion != 'f' && conversion != 'F';
+    if (conversion == 'g' || conversion == 'G') // significant digits
+        return precision == 0 ? 0 : precision - 1;
+    return precision;
+}
+
+// Write digits rounded with decimal_precision() as specified by fmt.
+static void
+append_decimal(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const char digits[static 1],
+    const unsigned length,
+    const int32_t exp)
+{
+    const unsigned char conversion = fmt.conversion_format;
+    const bool uppercase = conversion == 'F' || conversion == 'E' || conversion == 'G';
+    bool exp_notation;
+    const unsigned precision = decimal_precision(fmt, &exp_notation);
+
+    if (conversion == 'f' || conversion == 'F')
+        append_decimal_fixed(
+            out, digits, length, exp, precision, false, fmt.flag.hash);
+    else if (conversion == 'e' || conversion == 'E')
+        append_decimal_exp(
+            out, digits, length, exp, precision, false, fmt.flag.hash, uppercase);
+    else if (exp >= -4 && (exp < 0 || (unsigned)exp <= precision))
+        append_decimal_fixed( // 'g', exponent after rounding selects notation
+            out, digits, length, exp, precision - exp, ! fmt.flag.hash, fmt.flag.hash);
+    else
+        append_decimal_exp(
+            out, digits, length, exp, precision, ! fmt.flag.hash, fmt.flag.hash, uppercase);
+}
+
+PF_TARGET_CLONES
+static unsigned
+write_float(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const float f)
+{
+    const size_t original_length = out->length;
+    const unsigned char conversion = fmt.conversion_format;
+    const bool uppercase = conversion == 'F' || conversion == 'E' ||
+        conversion == 'G' || conversion == 'R';
+    const uint32_t bits = float_to_bits(f);
+
+    if (conversion == 'a' || conversion == 'A') // same digits as double
+        return write_hex(out, fmt, (double)f);
+
+    // Decode bits into sign, mantissa, and exponent.
+    const bool ieeeSign =
+        ((bits >> (FLOAT_MANTISSA_BITS + FLOAT_EXPONENT_BITS)) & 1) != 0;
+    const uint32_t ieeeMantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+    const uint32_t ieeeExponent =
+        (bits >> FLOAT_MANTISSA_BITS) & ((1u << FLOAT_EXPONENT_BITS) - 1);
+
+    if (ieeeSign)
+        push_char(out, '-');
+    else if (fmt.flag.plus)
+        push_char(out, '+');
+    else if (fmt.flag.space)
+        push_char(out, ' ');
+
+    if (ieeeExponent == ((1u << FLOAT_EXPONENT_BITS) - 1u))
+    {
+        pf_copy_special_str_printf(out, ieeeMantissa, uppercase);
+        return out->length - original_length;
+    }
+
+    char digits[FLOAT_MAX_DIGITS];
+    int32_t exp = 0; // of the first digit
+    unsigned length;
+
+    if (conversion == 'r' || conversion == 'R') // Ryū f2s, precision ignored
+    {
+        length = 1;
+        digits[0] = '0';
+        if (ieeeExponent != 0 || ieeeMantissa != 0)
+        {
+            uint32_t mantissa;
+            int32_t exponent;
+            f2s_decimal(f, &mantissa, &exponent);
+            length = decimalLength9(mantissa);
+            append_n_digits(length, mantissa, digits);
+            exp = exponent + (int32_t)length - 1;
+        }
+        append_shortest(out, fmt, digits, length, exp, 9);
+
+        if (capacity_left(*out))
+            *end(*out) = '\0';
+        return out->length - original_length;
+    }
+
+    int32_t e2;
+    uint32_t m2;
+    if (ieeeExponent == 0) {
+        e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS;
+        m2 = ieeeMantissa;
+    } else {
+        e2 = (int32_t)ieeeExponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS;
+        m2 = (1u << FLOAT_MANTISSA_BITS) | ieeeMantissa;
+    }
+
+    bool exp_notation;
+    const unsigned precision = decimal_precision(fmt, &exp_notation);
+    length = float_to_decimal(m2, e2, exp_notation, precision, digits, &exp);
+    append_decimal(out, fmt, digits, length, exp);
+
+    if (capacity_left(*out))
+        *end(*out) = '\0';
+    return out->length - original_length;
+}
+
+// ---------------------------------------------------------------------------
+//
+// Small doubles
+//
+// With precision of at most 17 and a moderate exponent, the kept digits of
+// m2 * 2^e2 fit 64 bits. They are rounded exactly with a single 128-bit
+// multiplication by a power of ten and a shift, or a 64-bit division, instead
+// of generating blocks of digits with Ryū printf tables. Integers below 2^64,
+// like counts and sizes, are written as integers with any precision. Other
+// values fall back to write_fixed() and write_exp().
+//
+// ---------------------------------------------------------------------------
+
+// Store m2 * 2^e2 * 10^k rounded to nearest with ties to even to q, e2 < 0.
+// Returns false if the operands or the result don't fit.
+static inline bool
+small_scale_round(
+    const uint64_t m2, const int32_t e2, const int32_t k, uint64_t q[static 1])
+{
+    const unsigned shift = (unsigned)-e2;
+    if (k >= 0)
+    {
+        #if defined(__SIZEOF_INT128__)
+        if (k > 19 || shift > 127)
+            return false;
+        const unsigned __int128 x = (unsigned __int128)m2 * POW10_UINT64[k];
+        if ((x >> shift) >> 63 != 0)
+            return false;
+
+        const unsigned __int128 half = (unsigned __int128)1 << (shift - 1);
+        const unsigned __int128 rest = x & ((half << 1) - 1);
+        *q = (uint64_t)(x >> shift);
+        *q += rest > half || (rest == half && *q % 2);
+        #else
+        return false;
+        #endif
+    }
+    else
+    {
+        if (k < -19 || shift > 63 || POW10_UINT64[-k] > UINT64_MAX >> shift)
+            return false;
+        const uint64_t divisor = POW10_UINT64[-k] << shift;
+        const uint64_t rest    = m2 % divisor;
+        *q = m2 / divisor;
+        *q += rest > divisor - rest || (rest == divisor - rest && *q % 2);
+    }
+    return true;
+}
+
+// Write m2 * 2^e2 after the sign as specified by fmt. Returns false without
+// writing anything if the value is not an integer below 2^64 and the value or
+// precision is not small enough.
+static bool
+write_small_double(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const uint64_t m2,
+    const int32_t e2)
+{
+    bool exp_notation;
+    const unsigned precision = decimal_precision(fmt, &exp_notation);
+
+    uint64_t q;
+    int32_t exp; // of the last digit of q
+    const bool integer = e2 >= 0 ?
+        e2 <= __builtin_clzll(m2) :
+        e2 > -64 && (m2 & ((1ull << -e2) - 1)) == 0;
+    if (integer && ( ! exp_notation || precision > 17 || e2 >= 0))
+    { // exact, only rounded if exp_notation
+        q = e2 >= 0 ? m2 << e2 : m2 >> -e2;
+        exp = 0;
+
+        if (exp_notation && precision < 19 && q >= POW10_UINT64[precision + 1])
+        {
+            exp = (int32_t)(decimalLength20(q) - precision - 1);
+            const uint64_t divisor = POW10_UINT64[exp];
+            const uint64_t rest    = q % divisor;
+            q /= divisor;
+            q += rest > divisor - rest || (rest == divisor - rest && q % 2);
+        }
+    }
+    else if (precision > 17 || e2 >= 0)
+    {
+        return false;
+    }
+    else if ( ! exp_notation)
+    {
+        if ( ! small_scale_round(m2, e2, (int32_t)precision, &q))
+            return false;
+        exp = -(int32_t)precision;
+    }
+    else
+    { // 2^e <= m2 * 2^e2 < 2^(e + 1), decimal exponent is x or x + 1
+        const int32_t e = e2 + 63 - __builtin_clzll(m2);
+        int32_t x = e >= 0 ?
+            (int32_t)log10Pow2(e) : -(int32_t)log10Pow2(-e) - 1;
+
+        if ( ! small_scale_round(m2, e2, (int32_t)precision - x, &q))
+            return false;
+        if (q >= POW10_UINT64[precision + 1])
+        {
+            ++x;
+            if ( ! small_scale_round(m2, e2, (int32_t)precision - x, &q))
+                return false;
+        }
+        exp = x - (int32_t)precision;
+    }
+
+    // Digits like float_to_decimal() writes them
+    char digits[20];
+    unsigned length = 1;
+    if (q == 0)
+    {
+        digits[0] = '0';
+        exp = 0;
+    }
+    else
+    {
+        while (q % 10 == 0)
+        {
+            q /= 10;
+            exp++;
+        }
+        length = append_u64_digits(q, digits);
+        exp += (int32_t)length - 1;
+    }
+    append_decimal(out, fmt, digits, length, exp);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+//
+// Long double
+//
+// x87 extended precision and IEEE binary128 are formatted exactly with 32-bit
+// limbs like floats, but limbs cover the whole exponent range and mantissas
+// have up to 113 bits. Long double that is double uses Ryū printf. Other
+// formats are converted to double.
+//
+// ---------------------------------------------------------------------------
+
+#if LDBL_MANT_DIG == 64 || LDBL_MANT_DIG == 113
+#define PF_LONG_DOUBLE_EXACT 1
+#else
+#define PF_LONG_DOUBLE_EXACT 0
+#endif
+
+#if PF_LONG_DOUBLE_EXACT
+
+// Exact value of x87 long double has at most 11514 significant digits and
+// binary128 at most 11563. Leave room for digits written 9 at a time past them.
+#define LDOUBLE_MAX_DIGITS 11576
+
+// Limbs for fraction of the smallest subnormal or integer part of the largest
+// value, which has LDBL_MAX_10_EXP + 1 digits.
+#define LDOUBLE_LIMBS ((LDBL_MAX_EXP + LDBL_MANT_DIG + 64) / 32)
+#define LDOUBLE_MAX_CHUNKS ((LDBL_MAX_10_EXP + 1 + 8) / 9)
+
+// m * 2^e2 with 32-bit limbs of m least significant first
+struct LongDoubleBits
+{
+    bool sign;
+    bool is_nan;
+    bool is_inf;
+    uint32_t m[4];
+    int32_t e2;
+};
+
+static struct LongDoubleBits decode_long_double(const long double f)
+{
+    struct LongDoubleBits bits = {};
+    uint64_t lo;
+    uint64_t hi;
+    #if LDBL_MANT_DIG == 64 // explicit integer bit, sign and exponent in hi
+    uint16_t sign_exponent;
+    memcpy(&lo, &f, sizeof lo);
+    memcpy(&sign_exponent, (const char*)&f + sizeof lo, sizeof sign_exponent);
+    const uint32_t ieeeExponent = sign_exponent & 0x7FFF;
+    bits.sign   = sign_exponent >> 15;
+    bits.is_inf = ieeeExponent == 0x7FFF && (lo << 1) == 0;
+    bits.is_nan = ieeeExponent == 0x7FFF && (lo << 1) != 0;
+    bits.e2     = (int32_t)(ieeeExponent == 0 ? 1 : ieeeExponent) - 16383 - 63;
+    hi = 0;
+    #else // binary128
+    uint64_t halves[2];
+    memcpy(halves, &f, sizeof halves);
+    #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    lo = halves[1];
+    hi = halves[0];
+    #else
+    lo = halves[0];
+    hi = halves[1];
+    #endif
+    const uint32_t ieeeExponent = (hi >> 48) & 0x7FFF;
+    const uint64_t mantissa_hi  = hi & ((1ull << 48) - 1);
+    bits.sign   = hi >> 63;
+    bits.is_inf = ieeeExponent == 0x7FFF && mantissa_hi == 0 && lo == 0;
+    bits.is_nan = ieeeExponent == 0x7FFF && ! bits.is_inf;
+    bits.e2     = (int32_t)(ieeeExponent == 0 ? 1 : ieeeExponent) - 16383 - 112;
+    hi = mantissa_hi | (uint64_t)(ieeeExponent != 0) << 48;
+    #endif
+    bits.m[0] = (uint32_t)lo;
+    bits.m[1] = (uint32_t)(lo >> 32);
+    bits.m[2] = (uint32_t)hi;
+    bits.m[3] = (uint32_t)(hi >> 32);
+    return bits;
+}
+
+// result[0..5) = m << shift, shift < 32
+static inline void
+shift_limbs(const uint32_t m[static 4], const unsigned shift, uint32_t result[static 5])
+{
+    result[0] = m[0] << shift;
+    for (unsigned i = 1; i < 4; i++)
+        result[i] = m[i] << shift | (shift ? m[i - 1] >> (32 - shift) : 0);
+    result[4] = shift ? m[3] >> (32 - shift) : 0;
+}
+
+// Integer in limbs below top. Writes nothing for zero.
+static unsigned
+append_long_double_integer(
+    uint32_t limbs[static 1], unsigned top, char* const result)
+{
+    while (top > 0 && limbs[top - 1] == 0)
+        top--;
+    if (top == 0)
+        return 0;
+    if (top <= 2)
+        return append_u64_digits(
+            (top == 2 ? (uint64_t)limbs[1] << 32 : 0) | limbs[0], result);
+
+    uint32_t chunks[LDOUBLE_MAX_CHUNKS];
+    return append_limbs_integer(limbs, top, chunks, result);
+}
+
+// Same as float_to_decimal(), but for long double.
+static unsigned
+long_double_to_decimal(
+    const struct LongDoubleBits bits,
+    const bool exp_notation,
+    const unsigned precision,
+    char digits[static LDOUBLE_MAX_DIGITS],
+    int32_t exp[static 1])
+{
+    uint32_t limbs[LDOUBLE_LIMBS]; // least significant first
+    unsigned length;
+
+    if (bits.e2 >= 0) // integer
+    {
+        const unsigned word = bits.e2 / 32;
+        memset(limbs, 0, word * sizeof limbs[0]);
+        shift_limbs(bits.m, bits.e2 % 32, limbs + word);
+        length = append_long_double_integer(limbs, word + 5, digits);
+        return fraction_to_decimal(
+            limbs, 0, 0, 0, exp_notation, precision, digits, length, exp);
+    }
+
+    const unsigned k = -bits.e2; // fractional bits
+    uint32_t integer[5] = {0};
+    uint32_t fraction[4];
+    for (unsigned i = 0; i < 4; i++)
+    {
+        const unsigned word = i + k / 32;
+        if (word < 4)
+            integer[i] = bits.m[word] >> k % 32 |
+                (k % 32 && word < 3 ? bits.m[word + 1] << (32 - k % 32) : 0);
+        fraction[i] = 32 * i >= k ? 0 : 32 * (i + 1) <= k ? bits.m[i] :
+            bits.m[i] & ((1u << (k - 32 * i)) - 1);
+    }
+    length = append_long_double_integer(integer, 4, digits);
+
+    // Shift binary point to a limb boundary like float_to_decimal().
+    const unsigned end = (k + 31) / 32;
+    uint32_t shifted[5];
+    shift_limbs(fraction, 32 * end - k, shifted);
+    const unsigned high = end < 5 ? end : 5;
+    memcpy(limbs, shifted, high * sizeof limbs[0]);
+    return fraction_to_decimal(
+        limbs, 0, high, end, exp_notation, precision, digits, length, exp);
+}
+
+#endif // PF_LONG_DOUBLE_EXACT
+
+PF_TARGET_CLONES
+static unsigned
+write_long_double(
+    struct PFString out[static 1],
+    const PFFormatSpecifier fmt,
+    const long double f)
+{
+    #if PF_LONG_DOUBLE_EXACT
+    const size_t original_length = out->length;
+    const unsigned char conversion = fmt.conversion_format;
+    const struct LongDoubleBits bits = decode_long_double(f);
+
+    if ((conversion == 'a' || conversion == 'A') && ! bits.is_nan && ! bits.is_inf)
+    {
+        #if LDBL_MANT_DIG == 64 // leading digit from the top 4 bits like glibc
+        const uint64_t m = (uint64_t)bits.m[1] << 32 | bits.m[0];
+        return append_hex_float(out, fmt, bits.sign,
+            m >> 60, m & ((1ull << 60) - 1), 15, m != 0 ? bits.e2 + 60 : 0);
+        #else // 112 bits of fraction don't fit append_hex_float()
+        return write_hex(out, fmt, (double)f);
+        #endif
+    }
+
+    if (bits.sign)
+        push_char(out, '-');
+    else if (fmt.flag.plus)
+        push_char(out, '+');
+    else if (fmt.flag.space)
+        push_char(out, ' ');
+
+    if (bits.is_nan || bits.is_inf)
+    {
+        const bool uppercase = conversion == 'F' || conversion == 'E' ||
+            conversion == 'G' || conversion == 'R' || conversion == 'A';
+        pf_copy_special_str_printf(out, bits.is_nan, uppercase);
+        return out->length - original_length;
+    }
+
+    char digits[LDOUBLE_MAX_DIGITS];
+    int32_t exp = 0; // of the first digit
+    if (conversion == 'r' || conversion == 'R')
+    { // not necessarily shortest, but enough digits to round trip
+        const unsigned length = long_double_to_decimal(
+            bits, true, DECIMAL_DIG - 1, digits, &exp);
+        append_shortest(out, fmt, digits, length, exp, DECIMAL_DIG);
+    }
+    else
+    {
+        bool exp_notation;
+        const unsigned precision = decimal_precision(fmt, &exp_notation);
+        const unsigned length = long_double_to_decimal(
+            bits, exp_notation, precision, digits, &exp);
+        append_decimal(out, fmt, digits, length, exp);
+    }
+
+    if (capacity_left(*out))
+        *end(*out) = '\0';
+    return out->length - original_length;
 
-    if (capacity_left(out))
-        out.data[out.length] = '\0';
-    return out.length;
+    #else
+    return pf_strfromd_to_string(out, fmt, (double)f);
+    #endif
 }
@@ -355,6 +355,7 @@ static inline int copy_special_str_printf(char* const result, const bool sign, c
   return sign + 8;
 }
 
+PF_TARGET_CLONES
 int d2fixed_buffered_n(double d, uint32_t precision, char* result) {
   const uint64_t bits = double_to_bits(d);
 #ifdef RYU_DEBUG
@@ -563,6 +564,7 @@ char* d2fixed(double d, uint32_t precision) {
 
 
 
+PF_TARGET_CLONES
 int d2exp_buffered_n(double d, uint32_t precision, char* result) {
   const uint64_t bits = double_to_bits(d);
 #ifdef RYU_DEBUG
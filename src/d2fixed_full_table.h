@@ -31,6 +31,8 @@ static const uint16_t POW10_OFFSET[TABLE_SIZE] = {
   1084, 1118, 1153, 1188
 };
 
+// Rows of POW10_SPLIT and POW10_SPLIT_2 can be computed on demand instead.
+#ifndef RYU_NO_POW10_SPLIT
 static const uint64_t POW10_SPLIT[1224][3] = {
   {                    1u,    72057594037927936u,                    0u },
   {   699646928636035157u,             72057594u,                    0u },
@@ -1257,6 +1259,7 @@ static const uint64_t POW10_SPLIT[1224][3] = {
   {  9698096389749839992u,      197658450495420u,                    0u },
   {  8310173728816391804u,               197658u,                    0u },
 };
+#endif // RYU_NO_POW10_SPLIT
 
 #define TABLE_SIZE_2 69
 #define ADDITIONAL_BITS_2 120
@@ -1281,6 +1284,7 @@ static const uint8_t MIN_BLOCK_2[TABLE_SIZE_2] = {
     30,   30,   31,   31,   32,   32,   33,   34,    0
 };
 
+#ifndef RYU_NO_POW10_SPLIT
 static const uint64_t POW10_SPLIT_2[3133][3] = {
   {                    0u,                    0u,              3906250u },
   {                    0u,                    0u,         202000000000u },
@@ -4416,5 +4420,6 @@ static const uint64_t POW10_SPLIT_2[3133][3] = {
   {                    0u,                    0u,         241525390625u },
   {                    0u,                    0u,          33000000000u },
 };
+#endif // RYU_NO_POW10_SPLIT
 
 #endif // RYU_D2FIXED_FULL_TABLE_H
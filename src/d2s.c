@@ -50,31 +50,6 @@
 #define DOUBLE_EXPONENT_BITS 11
 #define DOUBLE_BIAS 1023
 
-static inline uint32_t decimalLength17(const uint64_t v) {
-  // This is slightly faster than a loop.
-  // The average output length is 16.38 digits, so we check high-to-low.
-  // Function precondition: v is not an 18, 19, or 20-digit number.
-  // (17 digits are sufficient for round-tripping.)
-  assert(v < 100000000000000000L);
-  if (v >= 10000000000000000L) { return 17; }
-  if (v >= 1000000000000000L) { return 16; }
-  if (v >= 100000000000000L) { return 15; }
-  if (v >= 10000000000000L) { return 14; }
-  if (v >= 1000000000000L) { return 13; }
-  if (v >= 100000000000L) { return 12; }
-  if (v >= 10000000000L) { return 11; }
-  if (v >= 1000000000L) { return 10; }
-  if (v >= 100000000L) { return 9; }
-  if (v >= 10000000L) { return 8; }
-  if (v >= 1000000L) { return 7; }
-  if (v >= 100000L) { return 6; }
-  if (v >= 10000L) { return 5; }
-  if (v >= 1000L) { return 4; }
-  if (v >= 100L) { return 3; }
-  if (v >= 10L) { return 2; }
-  return 1;
-}
-
 // A floating decimal representing m * 10^e.
 typedef struct floating_decimal_64 {
   uint64_t mantissa;
@@ -277,7 +252,7 @@ static inline int to_chars(const floating_decimal_64 v, const bool sign, char* c
   }
 
   uint64_t output = v.mantissa;
-  const uint32_t olength = decimalLength17(output);
+  const uint32_t olength = decimalLength20(output);
 
 
   // Print the decimal digits.
@@ -398,7 +373,6 @@ static inline bool d2d_small_int(const uint64_t ieeeMantissa, const uint32_t iee
 
   // f is an integer in the range [1, 2^53).
   // Note: mantissa might contain trailing (decimal) 0's.
-  // Note: since 2^53 < 10^16, there is no need to adjust decimalLength17().
   v->mantissa = m2 >> -e2;
   v->exponent = 0;
   return true;
@@ -440,6 +414,31 @@ int d2s_buffered_n(double f, char* result) {
   return to_chars(v, ieeeSign, result);
 }
 
+// Added for printf. Shortest decimal representation of finite nonzero f as
+// *mantissa * 10^*exponent without trailing zeros in *mantissa. Sign is ignored.
+void d2s_decimal(double f, uint64_t* mantissa, int32_t* exponent) {
+  const uint64_t bits = double_to_bits(f);
+  const uint64_t ieeeMantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
+  const uint32_t ieeeExponent = (uint32_t) ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+
+  floating_decimal_64 v;
+  if (d2d_small_int(ieeeMantissa, ieeeExponent, &v)) {
+    for (;;) {
+      const uint64_t q = div10(v.mantissa);
+      const uint32_t r = ((uint32_t) v.mantissa) - 10 * ((uint32_t) q);
+      if (r != 0) {
+        break;
+      }
+      v.mantissa = q;
+      ++v.exponent;
+    }
+  } else {
+    v = d2d(ieeeMantissa, ieeeExponent);
+  }
+  *mantissa = v.mantissa;
+  *exponent = v.exponent;
+}
+
 void d2s_buffered(double f, char* result) {
   const int index = d2s_buffered_n(f, result);
 
@@ -0,0 +1,27 @@
+// MIT License
+// Copyright (c) 2023 Lauri Lorenzo Fiestas
+// https://github.com/PrinssiFiestas/printf/blob/main/LICENSE.md
+
+#ifndef FORMAT_CACHE_H_INCLUDED
+#define FORMAT_CACHE_H_INCLUDED
+
+#include <printf/format_scanning.h>
+#include <stdbool.h>
+
+// Same as PFCompiledFormat, but fixed size.
+typedef struct PFCachedFormat
+{
+    const char* format;
+    size_t tail_length;
+    size_t length;
+    PFFormatSpecifier specifiers[PF_FORMAT_CACHE_MAX_SPECIFIERS];
+} PFCachedFormat;
+
+// Fills out from cache, or scans fmt_string and adds it to cache. Returns false
+// if cache is disabled or fmt_string can not be cached, in which case out is
+// left in unspecified state.
+bool pf_format_cache_lookup(
+    const char fmt_string[static 1], // should be null-terminated
+    PFCachedFormat out[static 1]);
+
+#endif // FORMAT_CACHE_H_INCLUDED
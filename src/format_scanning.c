@@ -3,7 +3,10 @@
 // https://github.com/PrinssiFiestas/printf/blob/main/LICENSE.md
 
 #include <printf/format_scanning.h>
+#include "format_cache.h"
+#include <gpc/attributes.h>
 #include <string.h>
+#include <stdlib.h>
 
 PFFormatSpecifier
 pf_scan_format_string(
@@ -115,6 +118,11 @@ pf_scan_format_string(
             c++;
         }
     }
+    else if ((*c == 'w' || *c == 'I') && strncmp(c + 1, "128", 3) == 0)
+    {
+        fmt.length_modifier = 'w';
+        c += strlen("w128");
+    }
 
     fmt.conversion_format = *c;
     c++; // get to the end of string
@@ -122,3 +130,237 @@ pf_scan_format_string(
 
     return fmt;
 }
+
+static size_t compiled_format_size(const size_t length)
+{
+    return sizeof(PFCompiledFormat) + length * sizeof(PFFormatSpecifier);
+}
+
+PFCompiledFormat*
+pf_compile_format(
+    const char fmt_string[static 1])
+{
+    return pf_compile_format_with(&pf_heap_allocator, fmt_string);
+}
+
+PFCompiledFormat*
+pf_compile_format_with(
+    const PFAllocator allocator[static 1],
+    const char fmt_string[static 1])
+{
+    size_t length = 0;
+    for (const char* c = fmt_string; ; length++)
+    {
+        const PFFormatSpecifier fmt = pf_scan_format_string(c, NULL);
+        if (fmt.string == NULL)
+            break;
+        c = fmt.string + fmt.string_length;
+    }
+
+    PFCompiledFormat* compiled = allocator->alloc(
+        allocator->context, compiled_format_size(length));
+    if (compiled == NULL)
+        return NULL;
+
+    compiled->format = fmt_string;
+    compiled->length = length;
+
+    const char* c = fmt_string;
+    for (size_t i = 0; i < length; i++)
+    {
+        compiled->specifiers[i] = pf_scan_format_string(c, NULL);
+        c = compiled->specifiers[i].string +
+            compiled->specifiers[i].string_length;
+    }
+    compiled->tail_length = strlen(c);
+
+    return compiled;
+}
+
+void pf_free_compiled_format(PFCompiledFormat* compiled)
+{
+    free(compiled);
+}
+
+void pf_free_compiled_format_with(
+    const PFAllocator allocator[static 1], PFCompiledFormat* compiled)
+{
+    if (compiled != NULL)
+        allocator->free(
+            allocator->context, compiled, compiled_format_size(compiled->length));
+}
+
+// ---------------------------------------------------------------------------
+// Format cache
+
+// Number of slots, must be power of 2
+#ifndef PF_FORMAT_CACHE_SIZE
+#define PF_FORMAT_CACHE_SIZE 128
+#endif
+_Static_assert(
+    PF_FORMAT_CACHE_SIZE >= 2 &&
+    (PF_FORMAT_CACHE_SIZE & (PF_FORMAT_CACHE_SIZE - 1)) == 0,
+    "PF_FORMAT_CACHE_SIZE must be a power of 2 and at least 2");
+
+// Stored to length of formats that have too many specifiers to be cached so
+// they don't get scanned twice on every lookup.
+#define PF_UNCACHEABLE SIZE_MAX
+
+// Direct mapped. Each slot is guarded by a sequence lock: writers make sequence
+// odd while writing, readers copy the slot and retry or give up if sequence
+// changed meanwhile. This makes lookups lock-free, but copying the slot is
+// technically a data race, which is fine with GCC atomics and fences used here.
+static struct FormatCacheSlot
+{
+    unsigned sequence;
+    const char* format;
+    size_t tail_length;
+    size_t length;
+    PFFormatSpecifier specifiers[PF_FORMAT_CACHE_MAX_SPECIFIERS];
+} format_cache[PF_FORMAT_CACHE_SIZE];
+
+static bool format_cache_enabled = false;
+
+// Counters are striped so threads don't write to the same cache line on every
+// lookup. Each thread picks a stripe on its first lookup. Threads only share
+// stripes if there are more of them than stripes.
+#define FORMAT_CACHE_STRIPES 64
+
+static struct FormatCacheCounters
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} __attribute__((aligned(64))) format_cache_counters[FORMAT_CACHE_STRIPES];
+
+static unsigned format_cache_next_stripe;
+static GP_THREAD_LOCAL struct FormatCacheCounters* format_cache_stripe;
+
+static struct FormatCacheCounters* format_cache_thread_counters(void)
+{
+    if (format_cache_stripe == NULL)
+        format_cache_stripe = &format_cache_counters[__atomic_fetch_add(
+            &format_cache_next_stripe, 1, __ATOMIC_RELAXED) % FORMAT_CACHE_STRIPES];
+    return format_cache_stripe;
+}
+
+#define FORMAT_CACHE_COUNT(COUNTER) __atomic_fetch_add( \
+    &format_cache_thread_counters()->COUNTER, 1, __ATOMIC_RELAXED)
+
+void pf_format_cache_enable(bool enable)
+{
+    __atomic_store_n(&format_cache_enabled, enable, __ATOMIC_RELAXED);
+}
+
+PFFormatCacheStats pf_format_cache_stats(void)
+{
+    PFFormatCacheStats stats = {0};
+    for (size_t i = 0; i < FORMAT_CACHE_STRIPES; i++)
+    {
+        const struct FormatCacheCounters* c = &format_cache_counters[i];
+        stats.hits      += __atomic_load_n(&c->hits,      __ATOMIC_RELAXED);
+        stats.misses    += __atomic_load_n(&c->misses,    __ATOMIC_RELAXED);
+        stats.evictions += __atomic_load_n(&c->evictions, __ATOMIC_RELAXED);
+    }
+    return stats;
+}
+
+static size_t format_cache_index(const char* fmt_string)
+{
+    // Fibonacci hashing. Low bits are dropped since string literals tend to be
+    // aligned.
+    const uint64_t key = (uintptr_t)fmt_string >> 3;
+    return (key * 11400714819323198485ull) >> (64 - __builtin_ctz(PF_FORMAT_CACHE_SIZE));
+}
+
+static bool format_cache_read(
+    struct FormatCacheSlot slot[static 1],
+    const char* fmt_string,
+    PFCachedFormat out[static 1],
+    bool is_cacheable[static 1])
+{
+    const unsigned sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (sequence % 2 != 0 ||
+        __atomic_load_n(&slot->format, __ATOMIC_RELAXED) != fmt_string)
+        return false;
+
+    const size_t length = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+    if (length <= PF_FORMAT_CACHE_MAX_SPECIFIERS)
+    {
+        memcpy(out->specifiers, slot->specifiers, length * sizeof(out->specifiers[0]));
+        out->tail_length = slot->tail_length;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence)
+        return false;
+
+    *is_cacheable = length != PF_UNCACHEABLE;
+    out->format = fmt_string;
+    out->length = length;
+    return true;
+}
+
+static void format_cache_write(
+    struct FormatCacheSlot slot[static 1],
+    const PFCachedFormat in[static 1])
+{
+    unsigned sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    if (sequence % 2 != 0 || ! __atomic_compare_exchange_n(
+        &slot->sequence, &sequence, sequence + 1,
+        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return; // some other thread is writing, let it win
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (slot->format != NULL)
+        FORMAT_CACHE_COUNT(evictions);
+
+    __atomic_store_n(&slot->format, in->format, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->length, in->length, __ATOMIC_RELAXED);
+    if (in->length != PF_UNCACHEABLE)
+    {
+        slot->tail_length = in->tail_length;
+        memcpy(slot->specifiers, in->specifiers, in->length * sizeof(in->specifiers[0]));
+    }
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+bool pf_format_cache_lookup(
+    const char fmt_string[static 1],
+    PFCachedFormat out[static 1])
+{
+    if ( ! __atomic_load_n(&format_cache_enabled, __ATOMIC_RELAXED))
+        return false;
+
+    struct FormatCacheSlot* slot = &format_cache[format_cache_index(fmt_string)];
+    bool is_cacheable;
+    if (format_cache_read(slot, fmt_string, out, &is_cacheable))
+    {
+        FORMAT_CACHE_COUNT(hits);
+        return is_cacheable;
+    }
+    FORMAT_CACHE_COUNT(misses);
+
+    out->format = fmt_string;
+    out->length = 0;
+    const char* c = fmt_string;
+    while (1)
+    {
+        const PFFormatSpecifier fmt = pf_scan_format_string(c, NULL);
+        if (fmt.string == NULL)
+            break;
+        if (out->length == PF_FORMAT_CACHE_MAX_SPECIFIERS)
+        {
+            out->length = PF_UNCACHEABLE;
+            break;
+        }
+        out->specifiers[out->length++] = fmt;
+        c = fmt.string + fmt.string_length;
+    }
+    if (out->length != PF_UNCACHEABLE)
+        out->tail_length = strlen(c);
+
+    format_cache_write(slot, out);
+    return out->length != PF_UNCACHEABLE;
+}
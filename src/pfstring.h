@@ -6,6 +6,7 @@
 #define PFSTRING_H_INCLUDED
 
 #include <printf/printf.h>
+#include <printf/format_scanning.h>
 #include <string.h>
 #include <stdbool.h>
 
@@ -16,7 +17,14 @@ struct PFString
 
     char* data;
     size_t length;
-    const size_t capacity;
+    size_t capacity;
+
+    // Optional. If set, data is flushed to sink when full instead of cutting
+    // the output, and length never exceeds capacity + flushed. flushed is the
+    // number of characters already flushed, so the first character in data is
+    // at index flushed.
+    PFSink* sink;
+    size_t flushed;
 };
 
 static inline size_t min(const size_t a, const size_t b)
@@ -24,9 +32,22 @@ static inline size_t min(const size_t a, const size_t b)
     return a < b ? a : b;
 }
 
+// Length of the part of string that is still in data.
+static inline size_t buffered_length(const struct PFString me)
+{
+    return me.length - me.flushed;
+}
+
 static inline size_t capacity_left(const struct PFString me)
 {
-    return me.length >= me.capacity ? 0 : me.capacity - me.length;
+    const size_t length = buffered_length(me);
+    return length >= me.capacity ? 0 : me.capacity - length;
+}
+
+// Where the next character is to be written.
+static inline char* end(const struct PFString me)
+{
+    return me.data + buffered_length(me);
 }
 
 // Useful for memcpy(), memmove(), memset(), etc.
@@ -36,33 +57,85 @@ static inline size_t limit(const struct PFString me, const size_t x)
     return min(cap_left, x);
 }
 
+// Writes buffered data to sink which may provide new data buffer.
+static inline void flush(struct PFString me[static 1])
+{
+    if (buffered_length(*me) > 0)
+        me->sink->write(me->sink, me->data, buffered_length(*me));
+    me->flushed  = me->length;
+    me->data     = me->sink->buffer;
+    me->capacity = me->sink->capacity;
+}
+
+// Makes sure that at least n characters can be written directly to end() if
+// there is a sink.
+static inline void reserve(struct PFString me[static 1], const size_t n)
+{
+    if (me->sink != NULL && capacity_left(*me) < n)
+        flush(me);
+}
+
 // Mutating functions return successfully written characters, or in other words,
 // how much the resulting string grew.
 
 static inline size_t
-concat(struct PFString me[static 1], const char* src, const size_t length)
+concat(struct PFString me[static 1], const char* src, size_t length)
 {
-    memcpy(me->data + me->length, src, limit(*me, length));
+    if (me->sink != NULL && capacity_left(*me) < length)
+    {
+        const size_t total = length;
+        size_t n;
+        while (length > (n = capacity_left(*me)))
+        {
+            memcpy(end(*me), src, n);
+            me->length += n;
+            src        += n;
+            length     -= n;
+            flush(me);
+        }
+        memcpy(end(*me), src, length);
+        me->length += length;
+        return total;
+    }
+    memcpy(end(*me), src, limit(*me, length));
     me->length += length;
     return limit(*me, length);
 }
 
 static inline size_t
-pad(struct PFString me[static 1], const char c, const size_t length)
+pad(struct PFString me[static 1], const char c, size_t length)
 {
-    memset(me->data + me->length, c, limit(*me, length));
+    if (me->sink != NULL && capacity_left(*me) < length)
+    {
+        const size_t total = length;
+        size_t n;
+        while (length > (n = capacity_left(*me)))
+        {
+            memset(end(*me), c, n);
+            me->length += n;
+            length     -= n;
+            flush(me);
+        }
+        memset(end(*me), c, length);
+        me->length += length;
+        return total;
+    }
+    memset(end(*me), c, limit(*me, length));
     me->length += length;
     return limit(*me, length);
 }
 
+// i is index in the whole string, which must not be flushed yet. If there is a
+// sink, there must be space for n characters.
 static inline size_t
 insert_pad(
     struct PFString me[static 1],
-    const size_t i,
+    size_t i,
     const char c,
     const size_t n)
 {
-    const size_t real_length = min(me->length, me->capacity);
+    i -= me->flushed;
+    const size_t real_length = min(buffered_length(*me), me->capacity);
     me->length += n;
 
     if (i >= real_length)
@@ -86,10 +159,27 @@ insert_pad(
 
 static inline bool push_char(struct PFString me[static 1], const char c)
 {
+    reserve(me, 1);
     if (limit(*me, 1) != 0)
-        me->data[me->length] = c;
+        *end(*me) = c;
     me->length++;
     return limit(*me, 1);
 }
 
+// Implemented in conversions.c. Same as pf_strfromd(), but writes to a string
+// that may have a sink.
+unsigned pf_strfromd_to_string(
+    struct PFString out[static 1], PFFormatSpecifier fmt, double f);
+unsigned pf_strfromf_to_string(
+    struct PFString out[static 1], PFFormatSpecifier fmt, float f);
+unsigned pf_strfromld_to_string(
+    struct PFString out[static 1], PFFormatSpecifier fmt, long double f);
+
+#if defined(__SIZEOF_INT128__)
+// Implemented in conversions.c. Same as pf_otoa(), pf_xtoa(), or pf_Xtoa()
+// selected by conversion, but for 128-bit values.
+unsigned pf_pow2_u128toa(
+    size_t n, char* out, unsigned __int128 x, unsigned char conversion);
+#endif
+
 #endif // PFSTRING_H_INCLUDED
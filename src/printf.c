@@ -5,12 +5,44 @@
 #include <printf/printf.h>
 #include <printf/format_scanning.h>
 #include <printf/conversions.h>
+#include <printf/format.h>
+#include <printf/allocator.h>
 #include "pfstring.h"
+#include "format_cache.h"
+#include "common.h"
 
 #include <stdlib.h>
 #include <inttypes.h>
 #include <math.h>
 #include <limits.h>
+#include <float.h>
+
+#if defined(__GLIBC__)
+#include <wchar.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Enough for any integer conversion without precision in any base
+#if defined(__SIZEOF_INT128__)
+#define MAX_INTEGER_LENGTH (sizeof("-0x") + sizeof(__int128) * CHAR_BIT / 3)
+#else
+#define MAX_INTEGER_LENGTH (sizeof("-0x") + sizeof(uintmax_t) * CHAR_BIT / 3)
+#endif
+
+// Longest conversion excluding precision and field width, which is "%f" of
+// DBL_MAX. "%Lf" of LDBL_MAX can be longer.
+#define MAX_CONVERSION_LENGTH (DBL_MAX_10_EXP + 16)
+#define MAX_LONG_DOUBLE_LENGTH (LDBL_MAX_10_EXP + 16)
 
 struct MiscData
 {
@@ -49,13 +81,39 @@ static uintmax_t get_uint(pf_va_list args[static 1], const PFFormatSpecifier fmt
     }
 }
 
+static intmax_t get_int(pf_va_list args[static 1], const PFFormatSpecifier fmt)
+{
+    switch (fmt.length_modifier)
+    {
+        case 'j':
+            return va_arg(args->list, intmax_t);
+
+        case 'l' * 2:
+            return va_arg(args->list, long long);
+
+        case 'l':
+            return va_arg(args->list, long);
+
+        case 'h':
+            return (short)va_arg(args->list, int);
+
+        case 'h' * 2: // signed char is NOT char!
+            return (signed char)va_arg(args->list, int);
+
+        case 't':
+            return (ptrdiff_t)va_arg(args->list, ptrdiff_t);
+
+        default:
+            return va_arg(args->list, int);
+    }
+}
+
 static unsigned write_wc(
     struct PFString out[static 1],
-    pf_va_list args[static 1])
+    const uint32_t encoding)
 {
     uint8_t decoding[4];
     size_t length;
-    uint32_t encoding = va_arg(args->list, unsigned);
 
     if (encoding > 0x7F)
     {
@@ -89,11 +147,10 @@ static unsigned write_wc(
 
 static unsigned write_s(
     struct PFString out[static 1],
-    pf_va_list args[static 1],
+    const char* cstr,
     const PFFormatSpecifier fmt)
 {
     const size_t original_length = out->length;
-    const char* cstr = va_arg(args->list, const char*);
     if (cstr == NULL)
     {
         if (fmt.precision.option == PF_SOME &&
@@ -127,6 +184,27 @@ static unsigned write_s(
     return out->length - original_length;
 }
 
+static unsigned bit_length(const uintmax_t x)
+{
+    return x == 0 ? 1 : sizeof(x) * CHAR_BIT - __builtin_clzll(x);
+}
+
+// Zeroes to be written in front of digits of an unsigned conversion by either
+// precision or zero padding to field width. Padding is counted here too, so
+// digits can be written after zeroes instead of moving them afterwards.
+static unsigned zeroes_before_digits(
+    const unsigned digits,
+    const unsigned prefix_length,
+    const PFFormatSpecifier fmt)
+{
+    unsigned width = 0;
+    if (fmt.precision.option != PF_NONE)
+        width = fmt.precision.width;
+    else if (fmt.flag.zero && ! fmt.flag.dash && fmt.field.width > prefix_length)
+        width = fmt.field.width - prefix_length;
+    return width > digits ? width - digits : 0;
+}
+
 static void write_leading_zeroes(
     struct PFString out[static 1],
     const unsigned written_by_utoa,
@@ -137,11 +215,19 @@ static void write_leading_zeroes(
         const unsigned diff =
             fmt.precision.width <= written_by_utoa ? 0 :
             fmt.precision.width - written_by_utoa;
+        if (out->sink != NULL && capacity_left(*out) < written_by_utoa + diff)
+        { // zeroes don't fit in front of digits, write them through sink
+            char digits[MAX_INTEGER_LENGTH];
+            memcpy(digits, end(*out), written_by_utoa);
+            pad(out, '0', diff);
+            concat(out, digits, written_by_utoa);
+            return;
+        }
         memmove(
-            out->data + out->length + diff,
-            out->data + out->length,
+            end(*out) + diff,
+            end(*out),
             limit(*out, written_by_utoa));
-        memset(out->data + out->length, '0', limit(*out, diff));
+        memset(end(*out), '0', limit(*out, diff));
         out->length += written_by_utoa + diff;
     }
     else
@@ -153,41 +239,11 @@ static void write_leading_zeroes(
 static unsigned write_i(
     struct PFString out[static 1],
     struct MiscData md[static 1],
-    pf_va_list args[static 1],
+    const intmax_t i,
     const PFFormatSpecifier fmt)
 {
-    intmax_t i;
-    switch (fmt.length_modifier)
-    {
-        case 'j':
-            i = va_arg(args->list, intmax_t);
-            break;
-
-        case 'l' * 2:
-            i = va_arg(args->list, long long);
-            break;
-
-        case 'l':
-            i = va_arg(args->list, long);
-            break;
-
-        case 'h':
-            i = (short)va_arg(args->list, int);
-            break;
-
-        case 'h' * 2: // signed char is NOT char!
-            i = (signed char)va_arg(args->list, int);
-            break;
-
-        case 't':
-            i = (ptrdiff_t)va_arg(args->list, ptrdiff_t);
-            break;
-
-        default:
-            i = va_arg(args->list, int);
-    }
-
     const size_t original_length = out->length;
+    reserve(out, MAX_INTEGER_LENGTH);
 
     const char sign = i < 0 ? '-' : fmt.flag.plus ? '+' : fmt.flag.space ? ' ' : 0;
     if (sign)
@@ -197,7 +253,7 @@ static unsigned write_i(
     }
 
     const unsigned max_written = pf_utoa(
-        capacity_left(*out), out->data + out->length, imaxabs(i));
+        capacity_left(*out), end(*out), i < 0 ? -(uintmax_t)i : (uintmax_t)i);
 
     write_leading_zeroes(out, max_written, fmt);
     return out->length - original_length;
@@ -205,11 +261,11 @@ static unsigned write_i(
 
 static unsigned write_o(
     struct PFString out[static 1],
-    pf_va_list args[static 1],
+    const uintmax_t u,
     const PFFormatSpecifier fmt)
 {
     const size_t original_length = out->length;
-    const uintmax_t u = get_uint(args, fmt);
+    reserve(out, MAX_INTEGER_LENGTH);
 
     bool zero_written = false;
     if (fmt.flag.hash && u > 0)
@@ -219,7 +275,7 @@ static unsigned write_o(
     }
 
     const unsigned max_written = pf_otoa(
-        capacity_left(*out), out->data + out->length, u);
+        capacity_left(*out), end(*out), u);
 
     // zero_written tells pad_zeroes() to add 1 less '0'
     write_leading_zeroes(out, zero_written + max_written, fmt);
@@ -232,11 +288,11 @@ static unsigned write_o(
 static unsigned write_x(
     struct PFString out[static 1],
     struct MiscData md[static 1],
-    pf_va_list args[static 1],
+    const uintmax_t u,
     const PFFormatSpecifier fmt)
 {
     const size_t original_length = out->length;
-    const uintmax_t u = get_uint(args, fmt);
+    reserve(out, MAX_INTEGER_LENGTH);
 
     if (fmt.flag.hash && u > 0)
     {
@@ -244,21 +300,22 @@ static unsigned write_x(
         md->has_0x = true;
     }
 
-    const unsigned max_written = pf_xtoa(
-        capacity_left(*out), out->data + out->length, u);
+    pad(out, '0', zeroes_before_digits(
+        (bit_length(u) + 3) / 4, 2 * md->has_0x, fmt));
+    reserve(out, MAX_INTEGER_LENGTH);
+    out->length += pf_xtoa(capacity_left(*out), end(*out), u);
 
-    write_leading_zeroes(out, max_written, fmt);
     return out->length - original_length;
 }
 
 static unsigned write_X(
     struct PFString out[static 1],
     struct MiscData md[static 1],
-    pf_va_list args[static 1],
+    const uintmax_t u,
     const PFFormatSpecifier fmt)
 {
     const size_t original_length = out->length;
-    const uintmax_t u = get_uint(args, fmt);
+    reserve(out, MAX_INTEGER_LENGTH);
 
     if (fmt.flag.hash && u > 0)
     {
@@ -266,39 +323,40 @@ static unsigned write_X(
         md->has_0x = true;
     }
 
-    const unsigned max_written = pf_Xtoa(
-        capacity_left(*out), out->data + out->length, u);
+    pad(out, '0', zeroes_before_digits(
+        (bit_length(u) + 3) / 4, 2 * md->has_0x, fmt));
+    reserve(out, MAX_INTEGER_LENGTH);
+    out->length += pf_Xtoa(capacity_left(*out), end(*out), u);
 
-    write_leading_zeroes(out, max_written, fmt);
     return out->length - original_length;
 }
 
 static unsigned write_u(
     struct PFString out[static 1],
-    pf_va_list args[static 1],
+    const uintmax_t u,
     const PFFormatSpecifier fmt)
 {
     const size_t original_length = out->length;
-    const uintmax_t u = get_uint(args, fmt);
+    reserve(out, MAX_INTEGER_LENGTH);
     const unsigned max_written = pf_utoa(
-        capacity_left(*out), out->data + out->length, u);
+        capacity_left(*out), end(*out), u);
     write_leading_zeroes(out, max_written, fmt);
     return out->length - original_length;
 }
 
 static unsigned write_p(
     struct PFString out[static 1],
-    pf_va_list args[static 1],
+    const uintmax_t u,
     const PFFormatSpecifier fmt)
 {
     const size_t original_length = out->length;
-    const uintmax_t u = get_uint(args, fmt);
+    reserve(out, MAX_INTEGER_LENGTH);
 
     if (u > 0)
     {
         concat(out, "0x", strlen("0x"));
         const unsigned max_written = pf_xtoa(
-            capacity_left(*out), out->data + out->length, u);
+            capacity_left(*out), end(*out), u);
         write_leading_zeroes(out, max_written, fmt);
     }
     else
@@ -308,16 +366,90 @@ static unsigned write_p(
     return out->length - original_length;
 }
 
+#if defined(__SIZEOF_INT128__)
+// Same as write_i(), write_u(), write_o(), write_x(), and write_X() for values
+// with length modifier 'w'.
+static unsigned write_128(
+    struct PFString out[static 1],
+    struct MiscData md[static 1],
+    const PFArgValue arg,
+    const PFFormatSpecifier fmt)
+{
+    const size_t original_length = out->length;
+    reserve(out, MAX_INTEGER_LENGTH);
+
+    bool zero_written = false;
+    unsigned max_written;
+    switch (fmt.conversion_format)
+    {
+        case 'd': case 'i':
+        {
+            const char sign =
+                arg.i128 < 0 ? '-' : fmt.flag.plus ? '+' : fmt.flag.space ? ' ' : 0;
+            if (sign)
+            {
+                push_char(out, sign);
+                md->has_sign = true;
+            }
+            const unsigned __int128 u = arg.i128 < 0 ?
+                -(unsigned __int128)arg.i128 : (unsigned __int128)arg.i128;
+            max_written = pf_u128toa(capacity_left(*out), end(*out), u);
+        } break;
+
+        case 'u':
+            max_written = pf_u128toa(capacity_left(*out), end(*out), arg.u128);
+            break;
+
+        case 'o':
+            if (fmt.flag.hash && arg.u128 > 0)
+            {
+                push_char(out, '0');
+                zero_written = true;
+            }
+            max_written = pf_pow2_u128toa(
+                capacity_left(*out), end(*out), arg.u128, 'o');
+            break;
+
+        default: // 'x' or 'X'
+            if (fmt.flag.hash && arg.u128 > 0)
+            {
+                concat(out, fmt.conversion_format == 'x' ? "0x" : "0X", strlen("0x"));
+                md->has_0x = true;
+            }
+            max_written = pf_pow2_u128toa(
+                capacity_left(*out), end(*out), arg.u128, fmt.conversion_format);
+    }
+
+    // Same as in write_o()
+    write_leading_zeroes(out, zero_written + max_written, fmt);
+    out->length -= zero_written;
+    return out->length - original_length;
+}
+#endif
+
 static unsigned write_f(
     struct PFString out[static 1],
     struct MiscData md[static 1],
-    pf_va_list args[static 1],
+    const double f,
+    const PFFormatSpecifier fmt)
+{
+    const unsigned written_by_conversion = fmt.length_modifier == 'h' ?
+        pf_strfromf_to_string(out, fmt, (float)f) :
+        pf_strfromd_to_string(out, fmt, f);
+
+    md->has_sign = signbit(f) || fmt.flag.plus || fmt.flag.space;
+    md->is_nan_or_inf = isnan(f) || isinf(f);
+
+    return written_by_conversion;
+}
+
+static unsigned write_Lf(
+    struct PFString out[static 1],
+    struct MiscData md[static 1],
+    const long double f,
     const PFFormatSpecifier fmt)
 {
-    const double f = va_arg(args->list, double);
-    const unsigned written_by_conversion = pf_strfromd(
-        out->data + out->length, out->capacity, fmt, f);
-    out->length += written_by_conversion;
+    const unsigned written_by_conversion = pf_strfromld_to_string(out, fmt, f);
 
     md->has_sign = signbit(f) || fmt.flag.plus || fmt.flag.space;
     md->is_nan_or_inf = isnan(f) || isinf(f);
@@ -325,6 +457,16 @@ static unsigned write_f(
     return written_by_conversion;
 }
 
+static bool pads_with_zeroes(
+    const struct MiscData md,
+    const PFFormatSpecifier fmt)
+{
+    const bool is_int_with_precision =
+        strchr("diouxX", fmt.conversion_format) && fmt.precision.option != PF_NONE;
+    const bool ignore_zero = is_int_with_precision || md.is_nan_or_inf;
+    return fmt.flag.zero && ! ignore_zero;
+}
+
 static unsigned add_padding(
     struct PFString out[static 1],
     const unsigned written,
@@ -334,15 +476,11 @@ static unsigned add_padding(
     size_t start = out->length - written;
     const unsigned diff = fmt.field.width - written;
 
-    const bool is_int_with_precision =
-        strchr("diouxX", fmt.conversion_format) && fmt.precision.option != PF_NONE;
-    const bool ignore_zero = is_int_with_precision || md.is_nan_or_inf;
-
     if (fmt.flag.dash) // left justified, append padding
     {
         pad(out, ' ', diff);
     }
-    else if (fmt.flag.zero && ! ignore_zero) // fill in zeroes
+    else if (pads_with_zeroes(md, fmt)) // fill in zeroes
     { // 0-padding minding "0x" or sign prefix
         const unsigned offset = md.has_sign + 2 * md.has_0x;
         insert_pad(out, start + offset, '0', diff);
@@ -355,203 +493,1454 @@ static unsigned add_padding(
     return diff;
 }
 
+// Writes a single argument without field width padding. fmt.conversion_format
+// determines the active member of arg.
+static unsigned write_conversion(
+    struct PFString out[static 1],
+    struct MiscData misc[static 1],
+    const PFArgValue arg,
+    const PFFormatSpecifier fmt)
+{
+    unsigned written_by_conversion = 0;
 
+    #if defined(__SIZEOF_INT128__)
+    if (fmt.length_modifier == 'w' &&
+        fmt.conversion_format != '\0' && strchr("diouxX", fmt.conversion_format))
+        return write_128(out, misc, arg, fmt);
+    #endif
 
-// ---------------------------------------------------------------------------
-//
-//
-//
-// IMPLEMENTATIONS OF PUBLIC FUNCTIONS
-//
-//
-//
-// ---------------------------------------------------------------------------
+    switch (fmt.conversion_format)
+    {
+        case 'c':
+            if (fmt.length_modifier != 'l') {
+                push_char(out, (char)arg.u);
+                written_by_conversion = 1;
+            } else {
+                written_by_conversion += write_wc(out, arg.u);
+            } break;
+
+        case 's':
+            written_by_conversion += write_s(
+                out, arg.s, fmt);
+            break;
 
+        case 'd':
+        case 'i':
+            written_by_conversion += write_i(
+                out, misc, arg.i, fmt);
+            break;
 
+        case 'o':
+            written_by_conversion += write_o(
+                out, arg.u, fmt);
+            break;
 
-// ------------------------------
-// String functtions
+        case 'x':
+            written_by_conversion += write_x(
+                out, misc, arg.u, fmt);
+            break;
 
-int pf_vsnprintf(
-    char* restrict out_buf,
-    const size_t max_size,
-    const char format[restrict static 1],
-    va_list _args)
-{
-    struct PFString out = { out_buf, .capacity = max_size };
-    pf_va_list args;
-    va_copy(args.list, _args);
+        case 'X':
+            written_by_conversion += write_X(
+                out, misc, arg.u, fmt);
+            break;
 
-    while (1)
-    {
-        const PFFormatSpecifier fmt = pf_scan_format_string(format, &args);
-        if (fmt.string == NULL)
+        case 'u':
+            written_by_conversion += write_u(
+                out, arg.u, fmt);
             break;
 
-        concat(&out, format, fmt.string - format);
+        case 'p':
+            written_by_conversion += write_p(
+                out, arg.u, fmt);
+            break;
 
-        // Jump over format specifier for next iteration
-        format = fmt.string + fmt.string_length;
+        case 'f': case 'F':
+        case 'e': case 'E':
+        case 'g': case 'G':
+        case 'r': case 'R':
+        case 'a': case 'A':
+            if (fmt.length_modifier == 'L')
+                written_by_conversion += write_Lf(
+                    out, misc, arg.ld, fmt);
+            else
+                written_by_conversion += write_f(
+                    out, misc, arg.f, fmt);
+            break;
+
+        case '%':
+            push_char(out, '%');
+            break;
+    }
+    return written_by_conversion;
+}
+
+// Right justified fields that don't fit in sink buffer can't be padded after
+// the conversion, so padding is written first. Length of the conversion is
+// found by formatting it once without writing anything.
+static void write_prepadded(
+    struct PFString out[static 1],
+    const PFArgValue arg,
+    const PFFormatSpecifier fmt)
+{
+    PFFormatSpecifier unpadded = fmt;
+    unpadded.field.width = 0;
+    char nothing[1];
+    struct PFString measure = { nothing, .capacity = 0 };
+    struct MiscData misc = {};
+    const unsigned length = write_conversion(&measure, &misc, arg, unpadded);
+
+    if (length >= fmt.field.width)
+    {
+        write_conversion(out, &misc, arg, unpadded);
+        return;
+    }
+    const unsigned diff = fmt.field.width - length;
 
-        unsigned written_by_conversion = 0;
-        struct MiscData misc = {};
+    if ( ! pads_with_zeroes(misc, fmt))
+    {
+        pad(out, ' ', diff);
+        write_conversion(out, &misc, arg, unpadded);
+    }
+    else if (fmt.conversion_format == 'a' || fmt.conversion_format == 'A')
+    { // zeroes after sign and "0x" are written by the conversion
+        write_conversion(out, &misc, arg, fmt);
+    }
+    else if ( ! misc.has_sign && ! misc.has_0x)
+    {
+        pad(out, '0', diff);
+        write_conversion(out, &misc, arg, unpadded);
+    }
+    else if (strchr("diouxX", fmt.conversion_format))
+    { // zeroes after sign or "0x" are the same as precision
+        unpadded.precision.option = PF_SOME;
+        unpadded.precision.width =
+            fmt.field.width - misc.has_sign - 2 * misc.has_0x;
+        write_conversion(out, &misc, arg, unpadded);
+    }
+    else // floating point with sign
+    {
+        const bool is_long_double = fmt.length_modifier == 'L';
+        const bool negative = is_long_double ? signbit(arg.ld) : signbit(arg.f);
+        push_char(out, negative ? '-' : fmt.flag.plus ? '+' : ' ');
+        pad(out, '0', diff);
+        unpadded.flag.plus  = false;
+        unpadded.flag.space = false;
+        const PFArgValue absolute = is_long_double ?
+            (PFArgValue){ .ld = fabsl(arg.ld) } : (PFArgValue){ .f = fabs(arg.f) };
+        write_conversion(out, &misc, absolute, unpadded);
+    }
+}
 
-        switch (fmt.conversion_format)
+// Writes a single argument. fmt.conversion_format determines the active member
+// of arg.
+static void write_value(
+    struct PFString out[static 1],
+    const PFArgValue arg,
+    const PFFormatSpecifier fmt)
+{
+    if (out->sink != NULL &&
+        fmt.field.width > 0 && ! fmt.flag.dash && fmt.conversion_format != 's')
+    { // padding gets inserted in front of conversion, so don't flush it before
+        const size_t max_length = (size_t)fmt.field.width + fmt.precision.width +
+            (fmt.length_modifier == 'L' ? MAX_LONG_DOUBLE_LENGTH : MAX_CONVERSION_LENGTH);
+        if (max_length > out->capacity)
         {
-            case 'c':
-                if (fmt.length_modifier != 'l') {
-                    push_char(&out, (char)va_arg(args.list, int));
-                    written_by_conversion = 1;
-                } else {
-                    written_by_conversion += write_wc(&out, &args);
-                } break;
+            write_prepadded(out, arg, fmt);
+            return;
+        }
+        reserve(out, max_length);
+    }
 
-            case 's':
-                written_by_conversion += write_s(
-                    &out, &args, fmt);
-                break;
+    struct MiscData misc = {};
+    const unsigned written_by_conversion = write_conversion(out, &misc, arg, fmt);
 
-            case 'd':
-            case 'i':
-                written_by_conversion += write_i(
-                    &out, &misc, &args, fmt);
-                break;
+    if (written_by_conversion < fmt.field.width)
+        add_padding(
+            out,
+            written_by_conversion,
+            misc,
+            fmt);
+}
 
-            case 'o':
-                written_by_conversion += write_o(
-                    &out, &args, fmt);
-                break;
+static PFArgValue get_arg(
+    pf_va_list args[static 1],
+    const PFFormatSpecifier fmt)
+{
+    PFArgValue arg = {};
 
-            case 'x':
-                written_by_conversion += write_x(
-                    &out, &misc, &args, fmt);
-                break;
+    switch (fmt.conversion_format)
+    {
+        case 'c':
+            arg.u = va_arg(args->list, unsigned);
+            break;
 
-            case 'X':
-                written_by_conversion += write_X(
-                    &out, &misc, &args, fmt);
-                break;
+        case 's':
+            arg.s = va_arg(args->list, const char*);
+            break;
 
-            case 'u':
-                written_by_conversion += write_u(
-                    &out, &args, fmt);
+        case 'd': case 'i':
+            #if defined(__SIZEOF_INT128__)
+            if (fmt.length_modifier == 'w') {
+                arg.i128 = va_arg(args->list, __int128);
                 break;
+            }
+            #endif
+            arg.i = get_int(args, fmt);
+            break;
 
-            case 'p':
-                written_by_conversion += write_p(
-                    &out, &args, fmt);
+        case 'o': case 'x': case 'X': case 'u': case 'p':
+            #if defined(__SIZEOF_INT128__)
+            if (fmt.length_modifier == 'w' && fmt.conversion_format != 'p') {
+                arg.u128 = va_arg(args->list, unsigned __int128);
                 break;
+            }
+            #endif
+            arg.u = get_uint(args, fmt);
+            break;
 
-            case 'f': case 'F':
-            case 'e': case 'E':
-            case 'g': case 'G':
-                written_by_conversion += write_f(
-                    &out, &misc, &args, fmt);
+        case 'f': case 'F':
+        case 'e': case 'E':
+        case 'g': case 'G':
+        case 'r': case 'R':
+        case 'a': case 'A':
+            if (fmt.length_modifier == 'L') {
+                arg.ld = va_arg(args->list, long double);
                 break;
+            }
+            arg.f = va_arg(args->list, double);
+            if (fmt.length_modifier == 'h') // float, see write_f()
+                arg.f = (double)(float)arg.f;
+            break;
+    }
+    return arg;
+}
 
-            case '%':
-                push_char(&out, '%');
-                break;
-        }
+static void write_specifier(
+    struct PFString out[static 1],
+    pf_va_list args[static 1],
+    const PFFormatSpecifier fmt)
+{
+    write_value(out, get_arg(args, fmt), fmt);
+}
 
-        if (written_by_conversion < fmt.field.width)
-            add_padding(
-                &out,
-                written_by_conversion,
-                misc,
-                fmt);
-    }
+#if defined(__AVX2__) || defined(__SSE2__)
 
-    // Write what's left in format string
-    concat(&out, format, strlen(format));
-    if (max_size > 0)
-        out.data[capacity_left(out) ? out.length : out.capacity - 1] = '\0';
+#if defined(__AVX2__)
+typedef __m256i Vec;
 
-    va_end(args.list);
-    return out.length;
+static inline Vec vec_load_aligned(const char* p)
+{
+    return _mm256_load_si256((const Vec*)p);
 }
 
-int pf_vsprintf(
-    char buf[restrict static 1], const char fmt[restrict static 1], va_list args)
+static inline void vec_store(char* p, const Vec v)
 {
-    return pf_vsnprintf(buf, SIZE_MAX, fmt, args);
+    _mm256_storeu_si256((Vec*)p, v);
 }
 
-__attribute__((format (printf, 2, 3)))
-int pf_sprintf(char buf[restrict static 1], const char fmt[restrict static 1], ...)
+// Returns bitmask of '%' and '\0' characters in v.
+static inline uint32_t vec_find_specifier(const Vec v)
 {
-    va_list args;
-    va_start(args, fmt);
-    int written = pf_vsnprintf(buf, INT_MAX, fmt, args);
-    va_end(args);
-    return written;
+    return _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('%')),
+        _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
 }
+#else
+typedef __m128i Vec;
 
-__attribute__((format (printf, 3, 4)))
-int pf_snprintf(
-    char* restrict buf, const size_t n, const char fmt[restrict static 1], ...)
+static inline Vec vec_load_aligned(const char* p)
 {
-    va_list args;
-    va_start(args, fmt);
-    int written = pf_vsnprintf(buf, n, fmt, args);
-    va_end(args);
-    return written;
+    return _mm_load_si128((const Vec*)p);
 }
 
-// ------------------------------
-// IO functtions
-
-#define PAGE_SIZE 4096
-#define BUF_SIZE (PAGE_SIZE + sizeof(""))
+static inline void vec_store(char* p, const Vec v)
+{
+    _mm_storeu_si128((Vec*)p, v);
+}
 
-int pf_vfprintf(
-    FILE stream[restrict static 1], const char fmt[restrict static 1], va_list args)
+// Returns bitmask of '%' and '\0' characters in v.
+static inline uint32_t vec_find_specifier(const Vec v)
+{
+    return _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8('%')),
+        _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+}
+#endif
+
+// Copies literal text from format string until '%' or null-terminator and
+// returns pointer to it. Searching and copying is done in a single pass.
+// Aligned loads never cross page boundary, so reading past null-terminator is
+// safe, but not for address sanitizer.
+__attribute__((no_sanitize_address))
+static const char* write_literal(
+    struct PFString out[static 1],
+    const char* literal)
 {
-    char buf[BUF_SIZE];
-    char* pbuf = buf;
-    va_list args_copy;
-    va_copy(args_copy, args);
+    const char* chunk = (const char*)
+        ((uintptr_t)literal & ~(uintptr_t)(sizeof(Vec) - 1));
+    uint32_t found = vec_find_specifier(vec_load_aligned(chunk))
+        >> (literal - chunk);
 
-    const int out_length = pf_vsnprintf(buf, BUF_SIZE, fmt, args);
-    if (out_length >= (int)BUF_SIZE) // try again
+    if (found == 0)
     {
-        pbuf = malloc(out_length + sizeof(""));
-        pf_vsprintf(pbuf, fmt, args_copy);
+        chunk += sizeof(Vec);
+        concat(out, literal, chunk - literal);
+
+        Vec v;
+        while ((found = vec_find_specifier(v = vec_load_aligned(chunk))) == 0)
+        {
+            if (capacity_left(*out) >= sizeof(Vec)) {
+                vec_store(end(*out), v);
+                out->length += sizeof(Vec);
+            } else {
+                concat(out, chunk, sizeof(Vec));
+            }
+            chunk += sizeof(Vec);
+        }
+        literal = chunk;
     }
-    fwrite(pbuf, sizeof(char), out_length, stream);
 
-    if (pbuf != buf)
-        free(pbuf);
-    va_end(args_copy);
-    return out_length;
+    const size_t length = __builtin_ctz(found);
+    concat(out, literal, length);
+    return literal + length;
 }
 
-int pf_vprintf(
-    const char fmt[restrict static 1], va_list args)
-{
-    return pf_vfprintf(stdout, fmt, args);
-}
+#else // no SIMD
 
-__attribute__((format (printf, 1, 2)))
-int pf_printf(
-    const char fmt[restrict static 1], ...)
+// Copies literal text from format string until '%' or null-terminator and
+// returns pointer to it.
+static const char* write_literal(
+    struct PFString out[static 1],
+    const char* literal)
 {
-    va_list args;
-    va_start(args, fmt);
-    int n = pf_vfprintf(stdout, fmt, args);
-    va_end(args);
-    return n;
+    const size_t length = strcspn(literal, "%");
+    concat(out, literal, length);
+    return literal + length;
 }
 
-__attribute__((format (printf, 2, 3)))
-int pf_fprintf(
-    FILE stream[restrict static 1], const char fmt[restrict static 1], ...)
+#endif // no SIMD
+
+// Reads asterisks left unresolved by pf_compile_format() from args the same
+// way pf_scan_format_string() would.
+static void resolve_asterisks(
+    PFFormatSpecifier fmt[static 1],
+    pf_va_list args[static 1])
 {
-    va_list args;
-    va_start(args, fmt);
-    int n = pf_vfprintf(stream, fmt, args);
-    va_end(args);
+    if (fmt->field.asterisk)
+    {
+        const int width = va_arg(args->list, int);
+        fmt->field.asterisk = false;
+        if (width >= 0)
+            fmt->field.width = width;
+    }
+    if (fmt->precision.option == PF_ASTERISK)
+    {
+        const int width = va_arg(args->list, int);
+        if (width >= 0)
+        {
+            fmt->precision.option = PF_SOME;
+            fmt->precision.width = width;
+        }
+        else
+        {
+            fmt->precision.option = PF_NONE;
+        }
+    }
+}
+
+
+
+// ------------------------------
+// Measuring
+
+static unsigned precision_or(const PFFormatSpecifier fmt, const unsigned digits)
+{
+    if (fmt.precision.option == PF_SOME && fmt.precision.width > digits)
+        return fmt.precision.width;
+    return digits;
+}
+
+// Exact powers of ten representable as doubles.
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Returns the length of "%f" integer part of f >= 1 or 0 if it can't be
+// determined without digit generation.
+static unsigned integer_part_length(const double f, const unsigned precision)
+{
+    const unsigned max_exact = sizeof exact_pow10 / sizeof exact_pow10[0] - 1;
+    if (f >= exact_pow10[max_exact])
+        return 0;
+
+    unsigned length = 1;
+    while (f >= exact_pow10[length])
+        length++;
+
+    // Rounding at precision may carry to the next power of ten. Subtraction is
+    // exact when it matters.
+    if (precision > max_exact)
+        return length;
+    const double margin = exact_pow10[length] - f;
+    const double half_ulp = .5 / exact_pow10[precision];
+    if (margin > half_ulp * (1 + 1e-9))
+        return length;
+    if (margin < half_ulp * (1 - 1e-9))
+        return length + 1;
+    return 0; // tie, depends on exact digits
+}
+
+// Returns floor(log2(f)) for normal f. Subnormals give -1023.
+static int binary_exponent(const double f)
+{
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof bits);
+    return (int)((bits >> 52) & 0x7FF) - 1023;
+}
+
+// Returns the length of a floating point conversion or 0 if it can't be
+// determined without digit generation.
+static unsigned float_length(const double f, const PFFormatSpecifier fmt)
+{
+    const unsigned sign = signbit(f) || fmt.flag.plus || fmt.flag.space;
+    if (isnan(f) || isinf(f))
+        return sign + strlen("inf");
+
+    const unsigned precision =
+        fmt.precision.option == PF_SOME ? fmt.precision.width : 6;
+    const unsigned fraction =
+        precision > 0 || fmt.flag.hash ? strlen(".") + precision : 0;
+
+    switch (fmt.conversion_format)
+    {
+        case 'f': case 'F':
+        {
+            const double abs = fabs(f);
+            const unsigned integer = abs < 1. ? 1 : integer_part_length(abs, precision);
+            return integer == 0 ? 0 : sign + integer + fraction;
+        }
+
+        case 'e': case 'E':
+        { // only the length of the exponent is needed, which is 3 digits if
+          // the decimal exponent is at least 100 or at most -100
+            // floor(e2 * log10(2)), decimal exponent is this or this + 1
+            const int e2 = f == 0. ? 0 : binary_exponent(f);
+            const int estimate = e2 >= 0 ?
+                (e2 * 78913) >> 18 : -((-e2 * 78913 + (1 << 18) - 1) >> 18);
+            unsigned exponent_length;
+            if (-99 <= estimate && estimate <= 97)
+                exponent_length = 2;
+            else if (estimate <= -102 || 100 <= estimate)
+                exponent_length = 3;
+            else // rounding may change the exponent length
+                return 0;
+            return sign + 1 + fraction + strlen("e+") + exponent_length;
+        }
+
+        default: // 'g' trims zeroes, so digits are required
+            return 0;
+    }
+}
+
+// Returns the length of a conversion without padding and without writing it
+// where possible.
+static size_t conversion_length(const PFArgValue arg, const PFFormatSpecifier fmt)
+{
+    #if defined(__SIZEOF_INT128__)
+    switch (fmt.length_modifier == 'w' ? fmt.conversion_format : '\0')
+    {
+        case 'd': case 'i':
+        {
+            const bool sign = arg.i128 < 0 || fmt.flag.plus || fmt.flag.space;
+            const unsigned __int128 u = arg.i128 < 0 ?
+                -(unsigned __int128)arg.i128 : (unsigned __int128)arg.i128;
+            return sign + precision_or(fmt, decimalLength39(u));
+        }
+
+        case 'u':
+            return precision_or(fmt, decimalLength39(arg.u128));
+    }
+    #endif
+
+    // Other 128-bit integers are rare enough to be measured by writing
+    switch (fmt.length_modifier != 'w' ? fmt.conversion_format : '\0')
+    {
+        case 'c':
+            if (fmt.length_modifier != 'l')
+                return 1;
+            return 1 + (arg.u > 0x7F) + (arg.u > 0x7FF) + (arg.u > 0xFFFF);
+
+        case 'd': case 'i':
+        {
+            const bool sign = arg.i < 0 || fmt.flag.plus || fmt.flag.space;
+            return sign + precision_or(fmt, decimalLength20(
+                arg.i < 0 ? -(uintmax_t)arg.i : (uintmax_t)arg.i));
+        }
+
+        case 'u':
+            return precision_or(fmt, decimalLength20(arg.u));
+
+        case 'o':
+        {
+            const unsigned zero = fmt.flag.hash && arg.u > 0;
+            return precision_or(fmt, zero + (bit_length(arg.u) + 2) / 3);
+        }
+
+        case 'x': case 'X':
+        {
+            const unsigned prefix = fmt.flag.hash && arg.u > 0 ? strlen("0x") : 0;
+            return prefix + precision_or(fmt, (bit_length(arg.u) + 3) / 4);
+        }
+
+        case 'p':
+            if (arg.u == 0)
+                return strlen("(nil)");
+            return strlen("0x") + precision_or(fmt, (bit_length(arg.u) + 3) / 4);
+
+        case '%':
+            return 1;
+    }
+
+    if (fmt.length_modifier != 'L' && strchr("fFeE", fmt.conversion_format))
+    {
+        const unsigned length = float_length(arg.f, fmt);
+        if (length != 0)
+            return length;
+    }
+
+    // Strings are measured by writing too, nothing gets copied anyway
+    char nothing[1];
+    struct PFString measure = { nothing, .capacity = 0 };
+    struct MiscData misc = {};
+    PFFormatSpecifier unpadded = fmt;
+    unpadded.field.width = 0;
+    return write_conversion(&measure, &misc, arg, unpadded);
+}
+
+// ---------------------------------------------------------------------------
+//
+//
+//
+// IMPLEMENTATIONS OF PUBLIC FUNCTIONS
+//
+//
+//
+// ---------------------------------------------------------------------------
+
+
+
+// ------------------------------
+// String functtions
+
+// Writes format string pre-scanned to specifiers. Literal text is read from
+// between the specifiers.
+static void write_prescanned(
+    struct PFString out[static 1],
+    pf_va_list args[static 1],
+    const char* literal,
+    const PFFormatSpecifier specifiers[],
+    const size_t length,
+    const size_t tail_length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        PFFormatSpecifier fmt = specifiers[i];
+        concat(out, literal, fmt.string - literal);
+        literal = fmt.string + fmt.string_length;
+
+        resolve_asterisks(&fmt, args);
+        write_specifier(out, args, fmt);
+    }
+    concat(out, literal, tail_length);
+}
+
+static void write_format(
+    struct PFString out[static 1],
+    pf_va_list args[static 1],
+    const char* format)
+{
+    PFCachedFormat cached;
+    if (pf_format_cache_lookup(format, &cached))
+    {
+        write_prescanned(
+            out, args,
+            format, cached.specifiers, cached.length, cached.tail_length);
+        return;
+    }
+
+    while (1)
+    {
+        format = write_literal(out, format);
+        if (*format == '\0')
+            break;
+
+        const PFFormatSpecifier fmt = pf_scan_format_string(format, args);
+
+        // Jump over format specifier for next iteration
+        format = fmt.string + fmt.string_length;
+
+        write_specifier(out, args, fmt);
+    }
+}
+
+int pf_vsnprintf(
+    char* restrict out_buf,
+    const size_t max_size,
+    const char format[restrict static 1],
+    va_list _args)
+{
+    struct PFString out = { out_buf, .capacity = max_size };
+    pf_va_list args;
+    va_copy(args.list, _args);
+
+    write_format(&out, &args, format);
+
+    if (max_size > 0)
+        out.data[capacity_left(out) ? out.length : out.capacity - 1] = '\0';
+
+    va_end(args.list);
+    return out.length;
+}
+
+int pf_vsnprintf_compiled(
+    char* restrict out_buf,
+    const size_t max_size,
+    const PFCompiledFormat* restrict format,
+    va_list _args)
+{
+    struct PFString out = { out_buf, .capacity = max_size };
+    pf_va_list args;
+    va_copy(args.list, _args);
+
+    write_prescanned(
+        &out, &args,
+        format->format, format->specifiers, format->length, format->tail_length);
+
+    if (max_size > 0)
+        out.data[capacity_left(out) ? out.length : out.capacity - 1] = '\0';
+
+    va_end(args.list);
+    return out.length;
+}
+
+int pf_vsprintf(
+    char buf[restrict static 1], const char fmt[restrict static 1], va_list args)
+{
+    return pf_vsnprintf(buf, SIZE_MAX, fmt, args);
+}
+
+__attribute__((format (printf, 2, 3)))
+int pf_sprintf(char buf[restrict static 1], const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int written = pf_vsnprintf(buf, INT_MAX, fmt, args);
+    va_end(args);
+    return written;
+}
+
+__attribute__((format (printf, 3, 4)))
+int pf_snprintf(
+    char* restrict buf, const size_t n, const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int written = pf_vsnprintf(buf, n, fmt, args);
+    va_end(args);
+    return written;
+}
+
+int pf_snprintf_compiled(
+    char* restrict buf,
+    const size_t n,
+    const PFCompiledFormat* restrict fmt,
+    ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int written = pf_vsnprintf_compiled(buf, n, fmt, args);
+    va_end(args);
+    return written;
+}
+
+// ------------------------------
+// Measuring functions
+
+int pf_vformatted_length(const char format[restrict static 1], va_list _args)
+{
+    pf_va_list args;
+    va_copy(args.list, _args);
+    size_t length = 0;
+
+    while (1)
+    {
+        const size_t literal_length = strcspn(format, "%");
+        length += literal_length;
+        format += literal_length;
+        if (*format == '\0')
+            break;
+
+        const PFFormatSpecifier fmt = pf_scan_format_string(format, &args);
+        format = fmt.string + fmt.string_length;
+
+        const size_t conversion = conversion_length(get_arg(&args, fmt), fmt);
+        length += conversion > fmt.field.width ? conversion : fmt.field.width;
+    }
+
+    va_end(args.list);
+    return length;
+}
+
+__attribute__((format (printf, 1, 2)))
+int pf_formatted_length(const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = pf_vformatted_length(fmt, args);
+    va_end(args);
+    return n;
+}
+
+// ------------------------------
+// Sink functions
+
+// Writes either format or compiled format to sink, but leaves the last chunk
+// unflushed.
+static struct PFString sink_write_format(
+    PFSink sink[static 1],
+    const char* format,
+    const PFCompiledFormat* compiled,
+    va_list _args)
+{
+    struct PFString out = {
+        sink->buffer, .capacity = sink->capacity, .sink = sink };
+    pf_va_list args;
+    va_copy(args.list, _args);
+
+    if (compiled != NULL)
+        write_prescanned(
+            &out, &args,
+            compiled->format,
+            compiled->specifiers,
+            compiled->length,
+            compiled->tail_length);
+    else
+        write_format(&out, &args, format);
+
+    va_end(args.list);
+    return out;
+}
+
+// Writes either format or compiled format to sink.
+static int sink_printf(
+    PFSink sink[static 1],
+    const char* format,
+    const PFCompiledFormat* compiled,
+    va_list args)
+{
+    struct PFString out = sink_write_format(sink, format, compiled, args);
+    flush(&out);
+    return out.length;
+}
+
+int pf_vsinkprintf(
+    PFSink sink[restrict static 1],
+    const char format[restrict static 1],
+    va_list args)
+{
+    return sink_printf(sink, format, NULL, args);
+}
+
+__attribute__((format (printf, 2, 3)))
+int pf_sinkprintf(
+    PFSink sink[restrict static 1], const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int written = pf_vsinkprintf(sink, fmt, args);
+    va_end(args);
+    return written;
+}
+
+// ------------------------------
+// Allocating functions
+
+#define ASPRINTF_INITIAL_CAPACITY 256
+
+struct GrowingSink
+{
+    PFSink sink;
+    const PFAllocator* allocator;
+    char* data;
+    size_t capacity;
+    bool failed;
+    char discard[PF_SINK_MIN_CAPACITY]; // for output after failed allocation
+};
+
+// Output is written in place, so just make room for more.
+static void grow(PFSink sink[static 1], const char* data, size_t length)
+{
+    struct GrowingSink* growing = sink->context;
+    if ( ! growing->failed)
+    {
+        const size_t length_so_far = data + length - growing->data;
+        const PFAllocator* allocator = growing->allocator;
+        char* new_data = allocator->realloc(
+            allocator->context,
+            growing->data, growing->capacity, 2 * growing->capacity);
+        if (new_data != NULL)
+        {
+            growing->data     = new_data;
+            growing->capacity = 2 * growing->capacity;
+            sink->buffer   = new_data + length_so_far;
+            sink->capacity = growing->capacity - length_so_far;
+            return;
+        }
+        allocator->free(allocator->context, growing->data, growing->capacity);
+        growing->data   = NULL;
+        growing->failed = true;
+    }
+    // Keep formatting to get the length
+    sink->buffer   = growing->discard;
+    sink->capacity = sizeof growing->discard;
+}
+
+static int allocating_printf(
+    const PFAllocator allocator[static 1],
+    char** restrict result,
+    const bool shrink_to_fit,
+    const char format[restrict static 1],
+    va_list args)
+{
+    struct GrowingSink growing = {
+        .sink = { grow },
+        .allocator = allocator,
+        .data = allocator->alloc(allocator->context, ASPRINTF_INITIAL_CAPACITY),
+        .capacity = ASPRINTF_INITIAL_CAPACITY,
+        .failed = false,
+    };
+    *result = NULL;
+    if (growing.data == NULL)
+        return -1;
+    growing.sink.context  = &growing;
+    growing.sink.buffer   = growing.data;
+    growing.sink.capacity = growing.capacity;
+
+    struct PFString out = sink_write_format(&growing.sink, format, NULL, args);
+    if (capacity_left(out) == 0) // no room for null-terminator
+        grow(&growing.sink, out.data, buffered_length(out));
+    if (growing.failed)
+        return -1;
+
+    growing.data[out.length] = '\0';
+    if (shrink_to_fit && out.length + sizeof("") < growing.capacity)
+    {
+        char* exact = allocator->realloc(
+            allocator->context,
+            growing.data, growing.capacity, out.length + sizeof(""));
+        if (exact != NULL)
+            growing.data = exact;
+    }
+    *result = growing.data;
+    return out.length;
+}
+
+int pf_vasprintf(
+    char** restrict out, const char fmt[restrict static 1], va_list args)
+{
+    return allocating_printf(&pf_heap_allocator, out, false, fmt, args);
+}
+
+__attribute__((format (printf, 2, 3)))
+int pf_asprintf(char** restrict out, const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = allocating_printf(&pf_heap_allocator, out, false, fmt, args);
+    va_end(args);
+    return n;
+}
+
+int pf_vasprintf_shrink(
+    char** restrict out, const char fmt[restrict static 1], va_list args)
+{
+    return allocating_printf(&pf_heap_allocator, out, true, fmt, args);
+}
+
+__attribute__((format (printf, 2, 3)))
+int pf_asprintf_shrink(
+    char** restrict out, const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = allocating_printf(&pf_heap_allocator, out, true, fmt, args);
+    va_end(args);
+    return n;
+}
+
+int pf_vaprintf(
+    const PFAllocator* restrict allocator,
+    char** restrict out,
+    const char fmt[restrict static 1],
+    va_list args)
+{
+    return allocating_printf(allocator, out, true, fmt, args);
+}
+
+__attribute__((format (printf, 3, 4)))
+int pf_aprintf(
+    const PFAllocator* restrict allocator,
+    char** restrict out,
+    const char fmt[restrict static 1],
+    ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = allocating_printf(allocator, out, true, fmt, args);
+    va_end(args);
+    return n;
+}
+
+// ------------------------------
+// Array functions
+
+enum ArrayType { ARRAY_U64, ARRAY_I64, ARRAY_DOUBLE };
+
+// Format used for all elements. Conversion has to be valid for the type.
+static PFFormatSpecifier array_format(
+    const PFFormatSpecifier* fmt, const enum ArrayType type)
+{
+    const char* conversions[] = { "ouxX", "di", "fFeEgGrRaA" };
+    const unsigned char defaults[] = { 'u', 'd', 'f' };
+    if (fmt == NULL)
+        return (PFFormatSpecifier){ .conversion_format = defaults[type] };
+
+    PFFormatSpecifier result = *fmt;
+    if (result.conversion_format == '\0' ||
+        strchr(conversions[type], result.conversion_format) == NULL)
+        result.conversion_format = defaults[type];
+    result.field.asterisk = false;
+    result.length_modifier = 0;
+    if (result.precision.option == PF_ASTERISK)
+        result.precision.option = PF_NONE;
+    return result;
+}
+
+// Formats without flags, field width, or precision skip write_value().
+static bool is_plain(const PFFormatSpecifier fmt)
+{
+    return ! (fmt.flag.dash || fmt.flag.plus || fmt.flag.space ||
+        fmt.flag.hash || fmt.flag.zero) &&
+        fmt.field.width == 0 && fmt.precision.option == PF_NONE;
+}
+
+static void write_array(
+    struct PFString out[static 1],
+    const void* array,
+    const size_t length,
+    const char separator[static 1],
+    const PFFormatSpecifier* _fmt,
+    const enum ArrayType type)
+{
+    const PFFormatSpecifier fmt = array_format(_fmt, type);
+    const size_t separator_length = strlen(separator);
+    const bool plain = is_plain(fmt) &&
+        (fmt.conversion_format == 'u' || fmt.conversion_format == 'd');
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (i > 0)
+            concat(out, separator, separator_length);
+
+        switch (type)
+        {
+            case ARRAY_U64:
+                if (plain) {
+                    reserve(out, MAX_INTEGER_LENGTH);
+                    out->length += pf_utoa(
+                        capacity_left(*out), end(*out), ((const uint64_t*)array)[i]);
+                } else {
+                    write_value(out,
+                        (PFArgValue){ .u = ((const uint64_t*)array)[i] }, fmt);
+                } break;
+
+            case ARRAY_I64:
+                if (plain) {
+                    reserve(out, MAX_INTEGER_LENGTH);
+                    out->length += pf_itoa(
+                        capacity_left(*out), end(*out), ((const int64_t*)array)[i]);
+                } else {
+                    write_value(out,
+                        (PFArgValue){ .i = ((const int64_t*)array)[i] }, fmt);
+                } break;
+
+            case ARRAY_DOUBLE:
+                write_value(out,
+                    (PFArgValue){ .f = ((const double*)array)[i] }, fmt);
+                break;
+        }
+    }
+}
+
+static size_t array_to_buffer(
+    char* buf,
+    const size_t n,
+    const void* array,
+    const size_t length,
+    const char separator[static 1],
+    const PFFormatSpecifier* fmt,
+    const enum ArrayType type)
+{
+    struct PFString out = { buf, .capacity = n };
+    write_array(&out, array, length, separator, fmt, type);
+    if (n > 0)
+        out.data[capacity_left(out) ? out.length : out.capacity - 1] = '\0';
+    return out.length;
+}
+
+static size_t array_to_sink(
+    PFSink sink[static 1],
+    const void* array,
+    const size_t length,
+    const char separator[static 1],
+    const PFFormatSpecifier* fmt,
+    const enum ArrayType type)
+{
+    struct PFString out = {
+        sink->buffer, .capacity = sink->capacity, .sink = sink };
+    write_array(&out, array, length, separator, fmt, type);
+    flush(&out);
+    return out.length;
+}
+
+size_t pf_utoa_array(
+    char* buf, const size_t n,
+    const uint64_t array[], const size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt)
+{
+    return array_to_buffer(buf, n, array, length, separator, fmt, ARRAY_U64);
+}
+
+size_t pf_itoa_array(
+    char* buf, const size_t n,
+    const int64_t array[], const size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt)
+{
+    return array_to_buffer(buf, n, array, length, separator, fmt, ARRAY_I64);
+}
+
+size_t pf_ftoa_array(
+    char* buf, const size_t n,
+    const double array[], const size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt)
+{
+    return array_to_buffer(buf, n, array, length, separator, fmt, ARRAY_DOUBLE);
+}
+
+size_t pf_utoa_array_sink(
+    PFSink sink[static 1],
+    const uint64_t array[], const size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt)
+{
+    return array_to_sink(sink, array, length, separator, fmt, ARRAY_U64);
+}
+
+size_t pf_itoa_array_sink(
+    PFSink sink[static 1],
+    const int64_t array[], const size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt)
+{
+    return array_to_sink(sink, array, length, separator, fmt, ARRAY_I64);
+}
+
+size_t pf_ftoa_array_sink(
+    PFSink sink[static 1],
+    const double array[], const size_t length,
+    const char separator[static 1], const PFFormatSpecifier* fmt)
+{
+    return array_to_sink(sink, array, length, separator, fmt, ARRAY_DOUBLE);
+}
+
+// ------------------------------
+// Type-safe formatting
+
+static void write_arg(
+    PFWriter writer[static 1],
+    const PFArgValue arg,
+    const PFFormatSpecifier fmt)
+{
+    struct PFString out = { writer->data, writer->length, writer->capacity };
+    write_value(&out, arg, fmt);
+    writer->length = out.length;
+}
+
+void pf_write_arg(PFWriter* writer, const PFArg arg)
+{
+    write_arg(writer, arg.value, arg.fmt);
+}
+
+void pf_write_int(PFWriter* writer, const intmax_t i)
+{
+    write_arg(writer,
+        (PFArgValue){ .i = i }, (PFFormatSpecifier){ .conversion_format = 'i' });
+}
+
+void pf_write_uint(PFWriter* writer, const uintmax_t u)
+{
+    write_arg(writer,
+        (PFArgValue){ .u = u }, (PFFormatSpecifier){ .conversion_format = 'u' });
+}
+
+void pf_write_double(PFWriter* writer, const double f)
+{
+    write_arg(writer,
+        (PFArgValue){ .f = f }, (PFFormatSpecifier){ .conversion_format = 'g' });
+}
+
+void pf_write_float(PFWriter* writer, const float f)
+{
+    write_arg(writer,
+        (PFArgValue){ .f = (double)f },
+        (PFFormatSpecifier){ .conversion_format = 'g', .length_modifier = 'h' });
+}
+
+void pf_write_long_double(PFWriter* writer, const long double f)
+{
+    write_arg(writer,
+        (PFArgValue){ .ld = f },
+        (PFFormatSpecifier){ .conversion_format = 'g', .length_modifier = 'L' });
+}
+
+void pf_write_char(PFWriter* writer, const char c)
+{
+    struct PFString out = { writer->data, writer->length, writer->capacity };
+    push_char(&out, c);
+    writer->length = out.length;
+}
+
+void pf_write_string(PFWriter* writer, const char* s)
+{
+    write_arg(writer,
+        (PFArgValue){ .s = s }, (PFFormatSpecifier){ .conversion_format = 's' });
+}
+
+void pf_write_pointer(PFWriter* writer, const void* p)
+{
+    write_arg(writer,
+        (PFArgValue){ .u = (uintptr_t)p },
+        (PFFormatSpecifier){ .conversion_format = 'p' });
+}
+
+int pf_writer_end(PFWriter* writer)
+{
+    if (writer->capacity > 0)
+        writer->data[writer->length < writer->capacity ?
+            writer->length : writer->capacity - 1] = '\0';
+    return writer->length;
+}
+
+PFFormatSpecifier pf_static_spec_scan(PFStaticSpec* static_spec, const char* spec)
+{
+    const PFFormatSpecifier fmt = pf_scan_format_string(spec, NULL);
+
+    // Only one thread gets to store the result. Others just use their own.
+    unsigned state = 0;
+    if (__atomic_compare_exchange_n(
+        &static_spec->state, &state, 1,
+        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        static_spec->fmt = fmt;
+        __atomic_store_n(&static_spec->state, 2, __ATOMIC_RELEASE);
+    }
+    return fmt;
+}
+
+// ------------------------------
+// IO functtions
+
+#define PAGE_SIZE 4096
+
+#if defined(__GLIBC__)
+
+struct FileSink
+{
+    PFSink sink;
+    char buffer[PAGE_SIZE];
+};
+
+// Characters between _IO_write_ptr and _IO_write_end can be written directly
+// to the stream buffer. This is what glibc putc_unlocked() does too. Line
+// buffered and unbuffered streams have no room, so they always use fallback
+// buffer. Line buffered streams may even have _IO_write_end behind
+// _IO_write_ptr.
+static size_t file_buffer_room(const FILE stream[static 1])
+{
+    if (stream->_IO_write_end <= stream->_IO_write_ptr)
+        return 0;
+    return stream->_IO_write_end - stream->_IO_write_ptr;
+}
+
+static void write_file(PFSink sink[static 1], const char* data, size_t length)
+{
+    FILE* stream = sink->context;
+    bool was_file_buffer = data == stream->_IO_write_ptr;
+
+    if (was_file_buffer)
+        stream->_IO_write_ptr += length;
+    else
+        fwrite_unlocked(data, sizeof(char), length, stream);
+
+    if (was_file_buffer && file_buffer_room(stream) < PF_SINK_MIN_CAPACITY)
+        fflush_unlocked(stream); // empties buffer for the next chunk
+
+    if (file_buffer_room(stream) >= PF_SINK_MIN_CAPACITY)
+    {
+        sink->buffer   = stream->_IO_write_ptr;
+        sink->capacity = file_buffer_room(stream);
+    }
+    else
+    {
+        sink->buffer   = ((struct FileSink*)sink)->buffer;
+        sink->capacity = sizeof ((struct FileSink*)sink)->buffer;
+    }
+}
+
+// Locks the stream once and formats straight to its buffer if there is room.
+static int file_printf(
+    FILE stream[static 1],
+    const char* format,
+    const PFCompiledFormat* compiled,
+    va_list args)
+{
+    struct FileSink file_sink = { { write_file, stream } };
+    flockfile(stream);
+
+    if (fwide(stream, 0) <= 0 && file_buffer_room(stream) >= PF_SINK_MIN_CAPACITY)
+    {
+        file_sink.sink.buffer   = stream->_IO_write_ptr;
+        file_sink.sink.capacity = file_buffer_room(stream);
+    }
+    else
+    {
+        file_sink.sink.buffer   = file_sink.buffer;
+        file_sink.sink.capacity = sizeof file_sink.buffer;
+    }
+    const int length = sink_printf(&file_sink.sink, format, compiled, args);
+
+    funlockfile(stream);
+    return length;
+}
+
+#else // not glibc
+
+static void write_file(PFSink sink[static 1], const char* data, size_t length)
+{
+    fwrite(data, sizeof(char), length, sink->context);
+}
+
+static int file_printf(
+    FILE stream[static 1],
+    const char* format,
+    const PFCompiledFormat* compiled,
+    va_list args)
+{
+    char buf[PAGE_SIZE];
+    PFSink sink = { write_file, stream, buf, sizeof buf };
+    return sink_printf(&sink, format, compiled, args);
+}
+
+#endif // not glibc
+
+int pf_vfprintf(
+    FILE stream[restrict static 1], const char fmt[restrict static 1], va_list args)
+{
+    return file_printf(stream, fmt, NULL, args);
+}
+
+int pf_vfprintf_compiled(
+    FILE stream[restrict static 1],
+    const PFCompiledFormat* restrict fmt,
+    va_list args)
+{
+    return file_printf(stream, NULL, fmt, args);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Returns false if write() fails or writes nothing. Interrupted writes are
+// retried.
+static bool write_all(const int fd, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data   += written;
+        length -= written;
+    }
+    return true;
+}
+
+struct FdSinkContext
+{
+    int fd;
+    bool failed; // nothing is written after the first failure
+};
+
+static void write_fd(PFSink sink[static 1], const char* data, size_t length)
+{
+    struct FdSinkContext* context = sink->context;
+    if ( ! context->failed)
+        context->failed = ! write_all(context->fd, data, length);
+}
+
+int pf_vdprintf(int fd, const char fmt[restrict static 1], va_list args)
+{
+    char buf[PAGE_SIZE];
+    struct FdSinkContext context = { fd, false };
+    PFSink sink = { write_fd, &context, buf, sizeof buf };
+    const int length = sink_printf(&sink, fmt, NULL, args);
+    return context.failed ? -1 : length;
+}
+
+__attribute__((format (printf, 2, 3)))
+int pf_dprintf(int fd, const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = pf_vdprintf(fd, fmt, args);
+    va_end(args);
+    return n;
+}
+
+static void add_record(PFBatch batch[static 1], const char* data, size_t length)
+{
+    if (length == 0)
+        return;
+    batch->records[batch->count++] = (struct iovec){ (char*)data, length };
+    batch->length = data + length - batch->buffer;
+}
+
+int pf_batch_flush(PFBatch batch[static 1])
+{
+    struct iovec* records = batch->records;
+    int count = batch->count;
+    batch->count  = 0;
+    batch->length = 0;
+
+    while (count > 0)
+    {
+        ssize_t written = writev(batch->fd, records, count);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return -1;
+
+        // Skip fully written records, then the written part of the next one
+        for (; count > 0 && written >= (ssize_t)records->iov_len; count--)
+            written -= (records++)->iov_len;
+        if (count > 0) {
+            records->iov_base  = (char*)records->iov_base + written;
+            records->iov_len  -= written;
+        }
+    }
+    return 0;
+}
+
+struct BatchSinkContext
+{
+    PFBatch* batch;
+    bool failed;
+};
+
+// Called when batch buffer is full in the middle of a record.
+static void write_batch(PFSink sink[static 1], const char* data, size_t length)
+{
+    struct BatchSinkContext* context = sink->context;
+    PFBatch* batch = context->batch;
+    add_record(batch, data, length);
+    if (pf_batch_flush(batch) != 0)
+        context->failed = true;
+    sink->buffer   = batch->buffer;
+    sink->capacity = sizeof batch->buffer;
+}
+
+int pf_vbatch_printf(
+    PFBatch batch[restrict static 1],
+    const char fmt[restrict static 1],
+    va_list args)
+{
+    struct BatchSinkContext context = { batch, false };
+    if (batch->count == PF_BATCH_MAX_RECORDS ||
+        sizeof batch->buffer - batch->length < PF_SINK_MIN_CAPACITY)
+        context.failed = pf_batch_flush(batch) != 0;
+
+    PFSink sink = {
+        write_batch,
+        &context,
+        batch->buffer + batch->length,
+        sizeof batch->buffer - batch->length
+    };
+    const struct PFString out = sink_write_format(&sink, fmt, NULL, args);
+    add_record(batch, out.data, buffered_length(out));
+    return context.failed ? -1 : (int)out.length;
+}
+
+__attribute__((format (printf, 2, 3)))
+int pf_batch_printf(
+    PFBatch batch[restrict static 1], const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = pf_vbatch_printf(batch, fmt, args);
+    va_end(args);
     return n;
 }
 
+#endif // defined(__unix__) || defined(__APPLE__)
+
+int pf_vprintf(
+    const char fmt[restrict static 1], va_list args)
+{
+    return pf_vfprintf(stdout, fmt, args);
+}
+
+__attribute__((format (printf, 1, 2)))
+int pf_printf(
+    const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = pf_vfprintf(stdout, fmt, args);
+    va_end(args);
+    return n;
+}
+
+__attribute__((format (printf, 2, 3)))
+int pf_fprintf(
+    FILE stream[restrict static 1], const char fmt[restrict static 1], ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = pf_vfprintf(stream, fmt, args);
+    va_end(args);
+    return n;
+}
+
+int pf_fprintf_compiled(
+    FILE stream[restrict static 1],
+    const PFCompiledFormat* restrict fmt,
+    ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = pf_vfprintf_compiled(stream, fmt, args);
+    va_end(args);
+    return n;
+}
 
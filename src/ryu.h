@@ -26,10 +26,12 @@ extern "C" {
 int d2s_buffered_n(double f, char* result);
 void d2s_buffered(double f, char* result);
 char* d2s(double f);
+void d2s_decimal(double f, uint64_t* mantissa, int32_t* exponent);
 
 int f2s_buffered_n(float f, char* result);
 void f2s_buffered(float f, char* result);
 char* f2s(float f);
+void f2s_decimal(float f, uint32_t* mantissa, int32_t* exponent);
 
 int d2fixed_buffered_n(double d, uint32_t precision, char* result);
 void d2fixed_buffered(double d, uint32_t precision, char* result);
@@ -0,0 +1,82 @@
+#include "../src/allocator.c"
+#include <printf/printf.h>
+#include <printf/format_scanning.h>
+#include <gpc/assert.h>
+
+int main(void)
+{
+    _Alignas(max_align_t) char memory[1024];
+    PFArena arena = { memory, sizeof memory };
+    const PFAllocator allocator = pf_arena_allocator(&arena);
+
+    gp_suite("Arena");
+    {
+        gp_test("Bump allocation");
+        {
+            char* a = allocator.alloc(allocator.context, 10);
+            char* b = allocator.alloc(allocator.context, 10);
+            gp_expect(a == memory);
+            gp_expect(b > a + 10 && (uintptr_t)b % alignof(max_align_t) == 0);
+            gp_expect(allocator.alloc(allocator.context, sizeof memory) == NULL);
+        }
+
+        gp_test("Last allocation resized in place");
+        {
+            pf_arena_reset(&arena);
+            char* a = allocator.alloc(allocator.context, 10);
+            memcpy(a, "blah", sizeof "blah");
+            char* b = allocator.realloc(allocator.context, a, 10, 500);
+            gp_expect(a == b);
+            b = allocator.realloc(allocator.context, a, 500, 5);
+            gp_expect(arena.position == 5, (arena.position));
+
+            allocator.free(allocator.context, b, 5);
+            gp_expect(arena.position == 0, (arena.position));
+        }
+
+        gp_test("Older allocation moved");
+        {
+            pf_arena_reset(&arena);
+            char* a = allocator.alloc(allocator.context, 10);
+            memcpy(a, "blah", sizeof "blah");
+            allocator.alloc(allocator.context, 10);
+            char* b = allocator.realloc(allocator.context, a, 10, 20);
+            gp_assert(b != NULL && b != a);
+            gp_expect(strcmp(b, "blah") == 0);
+        }
+
+        gp_test("Reset");
+        {
+            pf_arena_reset(&arena);
+            gp_expect(allocator.alloc(allocator.context, sizeof memory) == memory);
+        }
+    }
+
+    gp_suite("Allocating functions");
+    {
+        gp_test("pf_aprintf()");
+        {
+            pf_arena_reset(&arena);
+            char* str;
+            int ret = pf_aprintf(&allocator, &str, "%s %d", "blah", 42);
+            gp_expect(ret == (int)strlen("blah 42"), (ret));
+            gp_expect(strcmp(str, "blah 42") == 0, (str));
+            gp_expect(arena.position == sizeof "blah 42", (arena.position));
+
+            gp_expect(pf_aprintf(&allocator, &str, "%2000d", 1) == -1);
+            gp_expect(str == NULL);
+        }
+
+        gp_test("pf_compile_format_with()");
+        {
+            pf_arena_reset(&arena);
+            PFCompiledFormat* compiled =
+                pf_compile_format_with(&allocator, "%s %d");
+            gp_assert(compiled != NULL);
+            gp_expect(compiled->length == 2, (compiled->length));
+
+            pf_free_compiled_format_with(&allocator, compiled);
+            gp_expect(arena.position == 0, (arena.position));
+        }
+    }
+}
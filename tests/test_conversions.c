@@ -1,6 +1,16 @@
 #include "../src/conversions.c"
 #include <gpc/assert.h>
 #include "expect_str.h"
+#include "pcg_basic.h"
+#include <time.h>
+
+#ifndef FUZZ_COUNT
+#define FUZZ_COUNT 65536
+#endif
+
+#ifndef FUZZ_SEED_OFFSET
+#define FUZZ_SEED_OFFSET 0
+#endif
 
 struct test_case
 {
@@ -77,6 +87,77 @@ int main(void)
             gp_expect(len == strlen(buf2));
         }
 
+        gp_test("Every hexadecimal and octal digit count");
+        {
+            for (unsigned bits = 0; bits <= 64; bits++)
+            {
+                const uint64_t x = bits == 0 ? 0 : UINT64_MAX >> (64 - bits);
+                sprintf(buf2, "%" PRIo64, x);
+                len = pf_otoa(-1, buf, x);
+                expect_str(buf, buf2);
+                gp_expect(len == strlen(buf2), (len));
+
+                sprintf(buf2, "%" PRIx64, x);
+                len = pf_xtoa(-1, buf, x);
+                expect_str(buf, buf2);
+
+                memset(buf, 'X', sizeof buf);
+                pf_xtoa(3, buf, x);
+                gp_expect(memcmp(buf, buf2, min(3, strlen(buf2) + 1)) == 0);
+
+                sprintf(buf2, "%" PRIX64, x >> 1 | (x != 0));
+                len = pf_Xtoa(-1, buf, x >> 1 | (x != 0));
+                expect_str(buf, buf2);
+            }
+        }
+
+        #if defined(__SIZEOF_INT128__)
+        gp_test("128-bit integers");
+        {
+            char buf128[48];
+            const unsigned __int128 max = ~(unsigned __int128)0;
+            len = pf_u128toa(-1, buf128, max);
+            expect_str(buf128, "340282366920938463463374607431768211455");
+            gp_expect(len == 39, (len));
+
+            pf_u128toa(-1, buf128, (unsigned __int128)UINT64_MAX + 1);
+            expect_str(buf128, "18446744073709551616");
+
+            len = pf_i128toa(-1, buf128, -(__int128)(max >> 1) - 1);
+            expect_str(buf128, "-170141183460469231731687303715884105728");
+            gp_expect(len == 40, (len));
+
+            pf_i128toa(-1, buf128, -12345);
+            expect_str(buf128, "-12345");
+
+            // Chunks of 19 digits with leading zeroes
+            const uint64_t e19 = UINT64_C(10000000000000000000);
+            for (uint64_t low = 0; low < e19 - e19 / 7; low += e19 / 7)
+            {
+                const uint64_t high = low / 3 + 1;
+                sprintf(buf2, "%" PRIu64, high); // fits 24 characters
+                char expected[48];
+                sprintf(expected, "%s%019" PRIu64, buf2, low);
+                pf_u128toa(-1, buf128, (unsigned __int128)high * e19 + low);
+                expect_str(buf128, expected);
+            }
+
+            strcpy(buf128, "XXXXXXXXX");
+            len = pf_u128toa(5, buf128, max);
+            expect_str(buf128, "34028XXXX");
+            gp_expect(len == 39, (len));
+
+            pf_pow2_u128toa(-1, buf128, max, 'o');
+            expect_str(buf128, "3777777777777777777777777777777777777777777");
+            pf_pow2_u128toa(-1, buf128, (unsigned __int128)1 << 64, 'o');
+            expect_str(buf128, "2000000000000000000000");
+            pf_pow2_u128toa(-1, buf128, (unsigned __int128)0xdeadbeef << 64 | 0x1234, 'X');
+            expect_str(buf128, "DEADBEEF0000000000001234");
+            pf_pow2_u128toa(-1, buf128, max, 'x');
+            expect_str(buf128, "ffffffffffffffffffffffffffffffff");
+        }
+        #endif
+
         gp_test("Limit max characters");
         {
             strcpy(buf, "XXXXXX");
@@ -87,6 +168,36 @@ int main(void)
             pf_itoa(3, buf, -123456);
             expect_str(buf, "-12XXX");
         }
+
+        gp_test("Every digit count and limit");
+        {
+            uint64_t pow10 = 1;
+            for (unsigned digits = 1; digits <= 20; digits++)
+            {
+                const uint64_t values[] = {
+                    pow10, pow10 + 1, pow10 + pow10 / 2,
+                    digits == 20 ? UINT64_MAX : 10 * pow10 - 1
+                };
+                for (size_t i = 0; i < sizeof values / sizeof values[0]; i++)
+                {
+                    sprintf(buf2, "%" PRIu64, values[i]);
+                    for (size_t n = 0; n <= digits + 1; n++)
+                    {
+                        memset(buf, 'X', sizeof buf);
+                        len = pf_utoa(n, buf, values[i]);
+                        gp_assert(len == digits, (len), (values[i]));
+                        gp_assert(memcmp(buf, buf2, n < digits ? n : digits) == 0);
+                        gp_assert(buf[n < digits ? n : digits] ==
+                            (n > digits ? '\0' : 'X'), (n), (values[i]));
+                    }
+                    const int64_t negative = -(int64_t)(values[i] / 2);
+                    sprintf(buf2, "%" PRId64, negative);
+                    len = pf_itoa(-1, buf, negative);
+                    expect_str(buf, buf2);
+                }
+                pow10 *= digits < 20 ? 10 : 1;
+            }
+        }
     } // gp_suite("Integer conversions");
 
     char buf[2000] = "";
@@ -162,6 +273,202 @@ int main(void)
             gp_expect(return_value == strlen("0.00123456"), (return_value));
         }
 
+        // Calls pf_strfromd(), pf_strfromf(), or pf_strfromld() depending on the
+        // type of value and checks both the string and the returned length.
+        #define expect_strfrom(fmt, value, _expected) do \
+        { \
+            const char* expected = (_expected); \
+            const unsigned written = _Generic((value), \
+                float:       pf_strfromf, \
+                double:      pf_strfromd, \
+                long double: pf_strfromld)(buf, SIZE_MAX, (fmt), (value)); \
+            expect_str(buf, expected); \
+            gp_expect(written == strlen(expected), (written)); \
+        } while (0)
+
+        gp_test("Carrying and trimming across digit blocks");
+        {
+            const struct {
+                unsigned char conversion;
+                bool hash;
+                unsigned precision;
+                double value;
+                const char* string;
+            } cases[] = {
+                { 'f', false, 3,  1999999999.9999,     "2000000000.000"     },
+                { 'g', false, 12, 1999999999.9999,     "2000000000"         },
+                { 'g', true,  12, 999999999.99999,     "1000000000.00"      },
+                { 'g', false, 53, -200120687.841751277446746826171875,
+                    "-200120687.841751277446746826171875"                   },
+                { 'g', true,  9,  0.09999999999,       "0.100000000"        },
+                { 'g', true,  8,  0.0999999999,        "0.10000000"         },
+                { 'g', false, 0,  0.2,                 "0.2"                },
+                { 'f', false, 30, 0.5, "0.500000000000000000000000000000"   },
+                { 'f', false, 20, 1e-10,               "0.00000000010000000000" },
+                { 'f', false, 15, 0.99999999999999989, "1.000000000000000"  },
+                { 'g', false, 25, 0.1,         "0.1000000000000000055511151" },
+            };
+            for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++)
+            {
+                const PFFormatSpecifier fmt = {
+                    .conversion_format = cases[i].conversion,
+                    .flag.hash = cases[i].hash,
+                    .precision = { cases[i].precision, PF_SOME } };
+                expect_strfrom(fmt, cases[i].value, cases[i].string);
+            }
+        }
+
+        gp_test("Integral doubles");
+        {
+            const struct {
+                unsigned char conversion;
+                unsigned precision;
+                double value;
+                const char* string;
+            } cases[] = {
+                { 'f', 2,  123456789.,            "123456789.00"               },
+                { 'f', 0,  9223372036854775808.,  "9223372036854775808"        },
+                { 'f', 3,  1e19,              "10000000000000000000.000"       },
+                { 'e', 20, 12345.,        "1.23450000000000000000e+04"         },
+                { 'e', 2,  18446744073709549568., "1.84e+19"                   },
+                { 'e', 18, 18446744073709549568., "1.844674407370954957e+19"   },
+                { 'e', 0,  25.,                   "2e+01"                      },
+                { 'e', 0,  35.,                   "4e+01"                      },
+                { 'g', 25, 1e15,                  "1000000000000000"           },
+            };
+            for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++)
+            {
+                const PFFormatSpecifier fmt = {
+                    .conversion_format = cases[i].conversion,
+                    .precision = { cases[i].precision, PF_SOME } };
+                expect_strfrom(fmt, cases[i].value, cases[i].string);
+            }
+        }
+
+        gp_test("Shortest representation");
+        {
+            const struct { double value; const char* string; } cases[] = {
+                { 0.,       "0"         }, { -0.,      "-0"        },
+                { 0.1,      "0.1"       }, { 123.456,  "123.456"   },
+                { 1e16,     "10000000000000000"                    },
+                { 1e17,     "1e+17"     }, { 1e-5,     "1e-05"     },
+                { 0.0001,   "0.0001"    }, { 5e-324,   "5e-324"    },
+                { 100.,     "100"       }, { -2.5,     "-2.5"      },
+                { 1.7976931348623157e308, "1.7976931348623157e+308" },
+            };
+            const PFFormatSpecifier fmt = { .conversion_format = 'r' };
+            for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++)
+                expect_strfrom(fmt, cases[i].value, cases[i].string);
+
+            strcpy(buf, "XXXXXX");
+            return_value = pf_dtoa_shortest(3, buf, 123.456);
+            expect_str(buf, "123XXX");
+            gp_expect(return_value == (int)strlen("123.456"));
+        }
+
+        gp_test("Single precision");
+        {
+            const struct {
+                unsigned char conversion;
+                unsigned precision;
+                float value;
+                const char* string;
+            } cases[] = {
+                { 'f', 6,  0.1f,         "0.100000"         },
+                { 'e', 10, 0.1f,         "1.0000000149e-01" },
+                { 'g', 9,  16777216.f,   "16777216"         },
+                { 'f', 0,  2.5f,         "2"                },
+                { 'f', 0,  3.5f,         "4"                },
+                { 'e', 3,  3.4028235e38f,"3.403e+38"        },
+                { 'g', 6,  1e-45f,       "1.4013e-45"       },
+                { 'f', 50, 1e-45f,
+                    "0.00000000000000000000000000000000000000000000140130" },
+                { 'F', 3,  -1e10f,       "-10000000000.000" },
+                { 'G', 6,  1e-5f,        "1E-05"            },
+                { 'r', 0,  0.1f,         "0.1"              },
+                { 'r', 0,  -0.f,         "-0"               },
+                { 'r', 0,  1e-45f,       "1e-45"            },
+                { 'r', 0,  16777216.f,   "16777216"         },
+                { 'r', 0,  3.4028235e38f,"3.4028235e+38"    },
+                { 'R', 0,  1e10f,        "1E+10"            },
+            };
+            for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++)
+            {
+                const PFFormatSpecifier fmt = {
+                    .conversion_format = cases[i].conversion,
+                    .precision = { cases[i].precision, PF_SOME } };
+                expect_strfrom(fmt, cases[i].value, cases[i].string);
+            }
+        }
+
+        gp_test("Hexadecimal");
+        {
+            const struct {
+                unsigned char conversion;
+                int precision; // negative for none
+                double value;
+                const char* string;
+            } cases[] = {
+                { 'a', -1, 1.,            "0x1p+0"                   },
+                { 'a', -1, -0.,           "-0x0p+0"                  },
+                { 'a', -1, 0.1,           "0x1.999999999999ap-4"     },
+                { 'A', -1, 3e100,         "0X1.B6E83B85F253BP+333"   },
+                { 'a', -1, 0x1p-1074,     "0x0.0000000000001p-1022"  },
+                { 'a', 3,  0x1.0008p0,    "0x1.000p+0"               },
+                { 'a', 3,  0x1.0018p0,    "0x1.002p+0"               },
+                { 'a', 0,  0x1.fp0,       "0x2p+0"                   },
+                { 'a', 16, 0x1.8p1,       "0x1.8000000000000000p+1"  },
+            };
+            for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++)
+            {
+                const PFFormatSpecifier fmt = {
+                    .conversion_format = cases[i].conversion,
+                    .precision = { cases[i].precision,
+                        cases[i].precision < 0 ? PF_NONE : PF_SOME } };
+                expect_strfrom(fmt, cases[i].value, cases[i].string);
+            }
+
+            return_value = pf_atoa(SIZE_MAX, buf, -2.5);
+            expect_str(buf, "-0x1.4p+1");
+            memset(buf, 0, 20); // because truncation and null-termination
+            return_value = pf_Atoa(6, buf, 255.);
+            expect_str(buf, "0X1.FE");
+            gp_expect(return_value == strlen("0X1.FEP+7"), (return_value));
+        }
+
+        #if PF_LONG_DOUBLE_EXACT
+        gp_test("Long double");
+        {
+            const struct {
+                unsigned char conversion;
+                unsigned precision;
+                long double value;
+                const char* string;
+            } cases[] = {
+                { 'f', 0,  2.5L,          "2"                                 },
+                { 'f', 30, 0x1p-20L,      "0.000000953674316406250000000000"  },
+                { 'f', 0,  0x1p100L,      "1267650600228229401496703205376"   },
+                { 'F', 2,  -1e20L,        "-100000000000000000000.00"         },
+                { 'G', 20, 0x1p64L,       "18446744073709551616"              },
+                { 'e', 3,  LDBL_MAX,      "1.190e+4932"                       },
+                { 'E', 20, 0x1p-16400L,   "1.28254056667789211512E-4937"      },
+                { 'g', 6,  1e-4000L,      "1e-4000"                           },
+                { 'g', 0,  0.05L,         "0.05"                              },
+                { 'e', 0,  9.5L,          "1e+01"                             },
+                { 'r', 0,  0.5L,          "0.5"                               },
+                { 'r', 0,  -0.L,          "-0"                                },
+                { 'R', 0,  0x1p-30L,      "9.31322574615478515625E-10"        },
+            };
+            for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++)
+            {
+                const PFFormatSpecifier fmt = {
+                    .conversion_format = cases[i].conversion,
+                    .precision = { cases[i].precision, PF_SOME } };
+                expect_strfrom(fmt, cases[i].value, cases[i].string);
+            }
+        }
+        #endif
+
         // TODO NAN
     }
 
@@ -707,6 +1014,235 @@ int main(void)
             EXPECT_EXP(1e+83, 1, "1.0e+83");
         }
     }
+
+    #if ! PF_LAZY_POW10_TABLES
+    gp_suite("Lazy power of ten tables");
+    {
+        static uint64_t row[128][3]; // longest row has 87 entries
+
+        gp_test("POW10_SPLIT");
+        {
+            const uint32_t length = sizeof POW10_SPLIT / sizeof POW10_SPLIT[0];
+            for (uint32_t idx = 0; idx < TABLE_SIZE; idx++)
+            {
+                const uint32_t offset = POW10_OFFSET[idx];
+                const uint32_t end = idx + 1 < TABLE_SIZE ?
+                    POW10_OFFSET[idx + 1] : length;
+                gp_assert(end - offset <= sizeof row / sizeof row[0]);
+                pow10_split_entries(idx, 0, end - offset, row);
+                for (uint32_t i = 0; i < end - offset; i++)
+                    if ( ! gp_expect(
+                        memcmp(row[i], POW10_SPLIT[offset + i], sizeof row[i]) == 0,
+                        (idx), (i)))
+                        break;
+            }
+        }
+
+        gp_test("POW10_SPLIT_2");
+        {
+            for (uint32_t idx = 0; idx + 1 < TABLE_SIZE_2; idx++)
+            {
+                const uint32_t offset = POW10_OFFSET_2[idx];
+                const uint32_t length = POW10_OFFSET_2[idx + 1] - offset;
+                gp_assert(length <= sizeof row / sizeof row[0]);
+                pow10_split_2_entries(
+                    idx, MIN_BLOCK_2[idx], MIN_BLOCK_2[idx] + length, row);
+                for (uint32_t i = 0; i < length; i++)
+                    if ( ! gp_expect(
+                        memcmp(row[i], POW10_SPLIT_2[offset + i], sizeof row[i]) == 0,
+                        (idx), (i)))
+                        break;
+            }
+        }
+    }
+    #endif
+
+    gp_suite("Fuzz test");
+    {
+        // Seed RNG with date
+        {
+            time_t t = time(NULL);
+            struct tm* gmt = gmtime(&t);
+            gp_assert(gmt != NULL);
+            pcg32_srandom(
+                gmt->tm_mday + 100*gmt->tm_mon, gmt->tm_year + FUZZ_SEED_OFFSET);
+        }
+
+        gp_test("Integer conversions with random digit counts");
+        {
+            char expected[32];
+            char scalar[32];
+            for (unsigned iteration = 1; iteration <= FUZZ_COUNT; iteration++)
+            {
+                // Random bit width to cover all digit counts evenly
+                const uint64_t x = ((uint64_t)pcg32_random() << 32 | pcg32_random())
+                    >> pcg32_boundedrand(64);
+                const size_t n = pcg32_boundedrand(24);
+
+                // All implementations have to produce identical output
+                const unsigned length = append_u64_digits(x, scalar);
+                #if PF_SIMD_UTOA
+                memset(buf, 'X', 32);
+                gp_assert(append_u64_digits_sse2(x, buf) == length, (x));
+                gp_assert(memcmp(buf, scalar, length) == 0, (x));
+                if (__builtin_cpu_supports("ssse3"))
+                {
+                    gp_assert(append_u64_digits_ssse3(x, buf) == length, (x));
+                    gp_assert(memcmp(buf, scalar, length) == 0, (x));
+                }
+                #endif
+
+                sprintf(expected, "%" PRIu64, x);
+                memset(buf, 'X', 32);
+                gp_assert(pf_utoa(n, buf, x) == strlen(expected), (x));
+                gp_assert(memcmp(buf, expected, min(n, strlen(expected) + 1)) == 0,
+                    (x), (n));
+
+                sprintf(expected, "%" PRId64, (int64_t)x);
+                gp_assert(pf_itoa(-1, buf, (int64_t)x) == strlen(expected), (x));
+                expect_str(buf, expected);
+            }
+        }
+
+        gp_test("Shortest representation round trip");
+        {
+            char longest[32];
+            for (unsigned iteration = 1; iteration <= FUZZ_COUNT; iteration++)
+            {
+                const uint64_t bits =
+                    (uint64_t)pcg32_random() << 32 | pcg32_random();
+                double f;
+                memcpy(&f, &bits, sizeof f);
+                if (isnan(f) || isinf(f))
+                    continue;
+
+                pf_dtoa_shortest(sizeof buf, buf, f);
+                const double round_trip = strtod(buf, NULL);
+                gp_assert(memcmp(&round_trip, &f, sizeof f) == 0, (buf));
+
+                sprintf(longest, "%.17g", f);
+                gp_assert(strlen(buf) <= strlen(longest), (buf), (longest));
+            }
+        }
+
+        gp_test("Single precision");
+        {
+            char expected[512];
+            char format[32];
+            const char conversions[] = "fFeEgG";
+            for (unsigned iteration = 1; iteration <= FUZZ_COUNT; iteration++)
+            {
+                const uint32_t bits = pcg32_random();
+                float f;
+                memcpy(&f, &bits, sizeof f);
+
+                PFFormatSpecifier fmt = {
+                    .conversion_format = conversions[pcg32_boundedrand(6)] };
+                fmt.precision.option = PF_SOME;
+                fmt.precision.width  = pcg32_boundedrand(8) == 0 ?
+                    pcg32_boundedrand(160) : pcg32_boundedrand(12);
+                fmt.flag.plus = pcg32_boundedrand(4) == 0;
+                // glibc "%#g" misses trailing zeroes when rounding to power of 10
+                fmt.flag.hash = pcg32_boundedrand(4) == 0 &&
+                    fmt.conversion_format != 'g' && fmt.conversion_format != 'G';
+
+                sprintf(format, "%%%s%s.%u%c",
+                    fmt.flag.plus ? "+" : "", fmt.flag.hash ? "#" : "",
+                    fmt.precision.width, fmt.conversion_format);
+                sprintf(expected, format, (double)f);
+                gp_assert(pf_strfromf(buf, sizeof buf, fmt, f) == strlen(expected),
+                    (format), (expected));
+                expect_str(buf, expected);
+
+                if (isnan(f) || isinf(f))
+                    continue;
+                fmt = (PFFormatSpecifier){ .conversion_format = 'r' };
+                pf_strfromf(buf, sizeof buf, fmt, f);
+                const float round_trip = strtof(buf, NULL);
+                gp_assert(memcmp(&round_trip, &f, sizeof f) == 0, (buf));
+
+                sprintf(expected, "%.9g", (double)f);
+                gp_assert(strlen(buf) <= strlen(expected), (buf), (expected));
+            }
+        }
+
+        gp_test("Hexadecimal");
+        {
+            char expected[128];
+            char format[32];
+            for (unsigned iteration = 1; iteration <= FUZZ_COUNT; iteration++)
+            {
+                const uint64_t bits =
+                    (uint64_t)pcg32_random() << 32 | pcg32_random();
+                double f;
+                memcpy(&f, &bits, sizeof f);
+
+                PFFormatSpecifier fmt = {
+                    .conversion_format = pcg32_boundedrand(2) ? 'a' : 'A' };
+                fmt.precision.option = pcg32_boundedrand(2) ? PF_SOME : PF_NONE;
+                fmt.precision.width  = pcg32_boundedrand(20);
+                fmt.flag.plus = pcg32_boundedrand(4) == 0;
+                fmt.flag.hash = pcg32_boundedrand(4) == 0;
+                // Only zero padding is written by the conversion itself
+                fmt.flag.zero = pcg32_boundedrand(4) == 0;
+                fmt.field.width = fmt.flag.zero && isfinite(f) ? pcg32_boundedrand(40) : 0;
+
+                char precision[8] = "";
+                if (fmt.precision.option == PF_SOME)
+                    sprintf(precision, ".%u", fmt.precision.width);
+                sprintf(format, "%%%s%s%s%u%s%c",
+                    fmt.flag.plus ? "+" : "", fmt.flag.hash ? "#" : "",
+                    fmt.flag.zero ? "0" : "", fmt.field.width,
+                    precision, fmt.conversion_format);
+                sprintf(expected, format, f);
+                gp_assert(pf_strfromd(buf, sizeof buf, fmt, f) == strlen(expected),
+                    (format), (expected));
+                expect_str(buf, expected);
+            }
+        }
+
+        gp_test("Long double");
+        {
+            char expected[1024];
+            char format[32];
+            const char conversions[] = "fFeEgG";
+            for (unsigned iteration = 1; iteration <= FUZZ_COUNT; iteration++)
+            { // hexadecimal floating point string is exact for any format
+                const uint64_t mantissa =
+                    (uint64_t)pcg32_random() << 32 | pcg32_random();
+                const int exponent = pcg32_boundedrand(4) == 0 ?
+                    (int)pcg32_boundedrand(32900) - 16450 :
+                    (int)pcg32_boundedrand(200) - 100;
+                sprintf(format, "0x%" PRIx64 "p%d", mantissa, exponent);
+                const long double f = strtold(format, NULL);
+
+                PFFormatSpecifier fmt = {
+                    .conversion_format = conversions[pcg32_boundedrand(6)] };
+                fmt.precision.option = PF_SOME;
+                fmt.precision.width  = pcg32_boundedrand(8) == 0 ?
+                    pcg32_boundedrand(600) : pcg32_boundedrand(24);
+                fmt.flag.plus = pcg32_boundedrand(4) == 0;
+                // glibc "%#g" misses trailing zeroes when rounding to power of 10
+                fmt.flag.hash = pcg32_boundedrand(4) == 0 &&
+                    fmt.conversion_format != 'g' && fmt.conversion_format != 'G';
+
+                sprintf(format, "%%%s%s.%uL%c",
+                    fmt.flag.plus ? "+" : "", fmt.flag.hash ? "#" : "",
+                    fmt.precision.width, fmt.conversion_format);
+                if (snprintf(expected, sizeof expected, format, f) >= (int)sizeof expected)
+                    continue; // "%Lf" of large values
+                gp_assert(pf_strfromld(buf, sizeof buf, fmt, f) == strlen(expected),
+                    (format), (expected));
+                expect_str(buf, expected);
+
+                if (isinf(f))
+                    continue;
+                fmt = (PFFormatSpecifier){ .conversion_format = 'r' };
+                pf_strfromld(buf, sizeof buf, fmt, f);
+                gp_assert(strtold(buf, NULL) == f, (buf));
+            }
+        }
+    }
 }
 
 double int64Bits2Double(uint64_t bits)
@@ -36316,3 +36852,5 @@ const struct test_case all_binary_exponents[] = {
   },
 };
 const size_t all_binary_exponents_length = sizeof(all_binary_exponents)/sizeof(all_binary_exponents[0]);
+
+#include "pcg_basic.c"
@@ -41,4 +41,70 @@ int main(void)
             gp_expect(fmt.conversion_format == 'g');
         }
     }
+
+    gp_suite("Format compiling");
+    {
+        const char* format = "a %5d b %-*.*s c %% d";
+        PFCompiledFormat* compiled = pf_compile_format(format);
+        gp_assert(compiled != NULL);
+
+        gp_test("Specifiers");
+        {
+            gp_expect(compiled->length == 3, (compiled->length));
+            gp_expect(compiled->specifiers[0].conversion_format == 'd');
+            gp_expect(compiled->specifiers[0].field.width == 5);
+            gp_expect(compiled->specifiers[1].field.asterisk);
+            gp_expect(compiled->specifiers[1].precision.option == PF_ASTERISK);
+            gp_expect(compiled->specifiers[2].conversion_format == '%');
+        }
+
+        gp_test("Literals");
+        {
+            gp_expect(compiled->format == format);
+            gp_expect(compiled->specifiers[1].string == format + strlen("a %5d b "));
+            gp_expect(compiled->tail_length == strlen(" d"), (compiled->tail_length));
+        }
+
+        pf_free_compiled_format(compiled);
+    }
+
+    gp_suite("Format cache");
+    {
+        PFCachedFormat cached;
+        const char* format = "a %5d b %s c";
+
+        gp_test("Disabled by default");
+        {
+            gp_expect( ! pf_format_cache_lookup(format, &cached));
+        }
+
+        pf_format_cache_enable(true);
+
+        gp_test("Miss, then hit");
+        {
+            gp_expect(pf_format_cache_lookup(format, &cached));
+            gp_expect(pf_format_cache_lookup(format, &cached));
+            PFFormatCacheStats stats = pf_format_cache_stats();
+            gp_expect(stats.misses == 1, (stats.misses));
+            gp_expect(stats.hits   == 1, (stats.hits));
+
+            gp_expect(cached.format == format);
+            gp_expect(cached.length == 2, (cached.length));
+            gp_expect(cached.specifiers[0].field.width == 5);
+            gp_expect(cached.specifiers[1].conversion_format == 's');
+            gp_expect(cached.tail_length == strlen(" c"), (cached.tail_length));
+        }
+
+        gp_test("Too many specifiers");
+        {
+            const char* long_format = "%d%d%d%d%d%d%d%d%d";
+            gp_expect( ! pf_format_cache_lookup(long_format, &cached));
+            gp_expect( ! pf_format_cache_lookup(long_format, &cached));
+            PFFormatCacheStats stats = pf_format_cache_stats();
+            gp_expect(stats.misses == 2, (stats.misses));
+            gp_expect(stats.hits   == 2, (stats.hits));
+        }
+
+        pf_format_cache_enable(false);
+    }
 }
@@ -12,6 +12,21 @@
 #define FUZZ_SEED_OFFSET 0
 #endif
 
+struct Output
+{
+    char data[8192];
+    size_t length;
+    unsigned writes;
+};
+
+static void write_output(PFSink* sink, const char* data, size_t length)
+{
+    struct Output* output = sink->context;
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    output->writes++;
+}
+
 int main(void)
 {
     char buf[512] = "";
@@ -42,6 +57,11 @@ int main(void)
             pf_sprintf(buf,  "blah %lli blah", -LLONG_MAX + 5);
             sprintf(buf_std, "blah %lli blah", -LLONG_MAX + 5);
             expect_str(buf, buf_std);
+
+            const int ret = pf_sprintf(buf, "%jd", INTMAX_MIN);
+            sprintf(buf_std, "%jd", INTMAX_MIN);
+            expect_str(buf, buf_std);
+            gp_expect(pf_formatted_length("%jd", INTMAX_MIN) == ret, (buf));
         }
 
         gp_test("%o, %x, and %X");
@@ -59,6 +79,42 @@ int main(void)
             expect_str(buf, buf_std);
         }
 
+        #if defined(__SIZEOF_INT128__)
+        gp_test("128-bit integers");
+        {
+            const unsigned __int128 max = ~(unsigned __int128)0;
+            const __int128 min = -(__int128)(max >> 1) - 1;
+            const char* format = "%w128u|%I128d|%+w128i|%#w128x|%I128X|%#w128o";
+            int ret = pf_sprintf(buf, format,
+                max, min, (__int128)42, max >> 4, (unsigned __int128)0xbee << 64, max);
+            expect_str(buf,
+                "340282366920938463463374607431768211455|"
+                "-170141183460469231731687303715884105728|+42|"
+                "0xfffffffffffffffffffffffffffffff|BEE0000000000000000|"
+                "03777777777777777777777777777777777777777777");
+            gp_expect(ret == (int)strlen(buf), (ret));
+            gp_expect(pf_formatted_length(format,
+                max, min, (__int128)42, max >> 4, (unsigned __int128)0xbee << 64, max)
+                == ret);
+
+            format = "|%045w128d|%-42.40I128u|%#034w128x|";
+            pf_sprintf(buf, format, min, (unsigned __int128)7, (unsigned __int128)1 << 64);
+            expect_str(buf,
+                "|-00000170141183460469231731687303715884105728"
+                "|0000000000000000000000000000000000000007  "
+                "|0x00000000000000010000000000000000|");
+
+            format = "%w128u|%.3w128d|%+w128i";
+            unsigned __int128 p = 1;
+            for (int i = 0; i < 39; i++, p *= 10)
+            {
+                ret = pf_sprintf(buf, format, p - 1, -(__int128)(p - 1), (__int128)p);
+                gp_expect(pf_formatted_length(format,
+                    p - 1, -(__int128)(p - 1), (__int128)p) == ret, (i), (buf));
+            }
+        }
+        #endif
+
         gp_test("Floats");
         {
             pf_sprintf(buf,  "blah %f blah", 124.647);
@@ -87,6 +143,48 @@ int main(void)
             expect_str(buf, buf_std);
         }
 
+        gp_test("Shortest round trip %r");
+        {
+            const char* format = "|%r|%+12r|%-12R|%012r|%#r|% r|";
+            int ret = pf_sprintf(buf, format, 1e300, 2.5, 1e-7, -3.25, 1., -HUGE_VAL);
+            expect_str(buf, "|1e+300|        +2.5|1E-07       |-00000003.25|1.|-inf|");
+            gp_expect(ret == (int)strlen(buf), (ret));
+            gp_expect(pf_formatted_length(format,
+                1e300, 2.5, 1e-7, -3.25, 1., -HUGE_VAL) == ret);
+        }
+
+        gp_test("Single precision with 'h'");
+        {
+            const char* format = "|%hf|%+10.3he|%-8hg|%hr|%010hR|%hr|";
+            const double a = (double)0.1f;
+            const double b = (double)1e10f;
+            int ret = pf_sprintf(buf, format, a, b, a, a, b, 0.1);
+            expect_str(buf, "|0.100000|+1.000e+10|0.1     |0.1|000001E+10|0.1|");
+            gp_expect(ret == (int)strlen(buf), (ret));
+            gp_expect(pf_formatted_length(format, a, b, a, a, b, 0.1) == ret);
+        }
+
+        gp_test("Long double with 'L'");
+        {
+            const char* format = "|%Lf|%+12.3Le|%-8Lg|%010.2Lf|%.30Lf|%LG|";
+            const long double a = 0.1L;
+            const long double b = -1e1000L;
+            char buf_std[128];
+            int ret = pf_sprintf(buf, format, a, b, a, -a, a, b);
+            sprintf(buf_std, format, a, b, a, -a, a, b);
+            expect_str(buf, buf_std);
+            gp_expect(ret == (int)strlen(buf), (ret));
+            gp_expect(pf_formatted_length(format, a, b, a, -a, a, b) == ret);
+        }
+
+        gp_test("Hexadecimal floats");
+        {
+            int ret = pf_sprintf(buf, "|%a|%+012.2A|%-9.0a|%#a|%10a|",
+                1.0, -0x1.fffp3, 0x1.8p0, 2.0, -(double)INFINITY);
+            expect_str(buf, "|0x1p+0|-0X002.00P+3|0x2p+0   |0x1.p+1|      -inf|");
+            gp_expect(ret == (int)strlen(buf), (ret));
+        }
+
         gp_test("%p");
         {
             void* p = (void*)-1;
@@ -172,6 +270,10 @@ int main(void)
         {
             pf_sprintf(buf, "|%08i|", -1);
             expect_str(buf, "|-0000001|");
+
+            pf_sprintf(buf,  "|%016lx|%#018lX|%#08x|", 0xcafel, 0xcafel, 0);
+            sprintf(buf_std, "|%016lx|%#018lX|%#08x|", 0xcafel, 0xcafel, 0);
+            expect_str(buf, buf_std);
         }
 
         gp_test("#: Alternative form");
@@ -258,8 +360,462 @@ int main(void)
             pf_sprintf(buf, "bl%%ah");
             expect_str(buf, "bl%ah");
         }
+
+        gp_test("Long literals");
+        {
+            const char* text =
+                "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed "
+                "do eiusmod tempor incididunt ut labore et dolore magna aliqua.";
+            char format[256];
+            for (size_t offset = 0; offset < 40; offset++)
+            {
+                // Vary alignment and position of specifier
+                sprintf(format, "%.*s%%s%s", (int)offset, text, text + offset);
+                for (size_t size = 0; size < 160; size += 7)
+                {
+                    int ret     = pf_snprintf(buf,     size, format, "%");
+                    int ret_std = snprintf(buf_std, size, format, "%");
+                    if (size > 0)
+                        expect_str(buf, buf_std);
+                    gp_expect(ret == ret_std, (ret), (ret_std));
+                }
+                pf_sprintf(buf + offset, format, "%");
+                sprintf(buf_std + offset, format, "%");
+                expect_str(buf + offset, buf_std + offset);
+            }
+        }
     } // gp_suite("Misc");
 
+    gp_suite("Compiled formats");
+    {
+        gp_test("Same output as uncompiled");
+        {
+            const char* format = "blah %-8i|%+.3f|%#x %s%% %c";
+            PFCompiledFormat* compiled = pf_compile_format(format);
+            gp_assert(compiled != NULL);
+
+            pf_snprintf_compiled(buf, sizeof(buf), compiled,
+                -12, 3.14159, 0xbee, "bloink", 'x');
+            pf_snprintf(buf_std, sizeof(buf_std), format,
+                -12, 3.14159, 0xbee, "bloink", 'x');
+            expect_str(buf, buf_std);
+
+            pf_free_compiled_format(compiled);
+        }
+
+        gp_test("Asterisks");
+        {
+            PFCompiledFormat* compiled = pf_compile_format("|%*.*d|%-*s|");
+            gp_assert(compiled != NULL);
+
+            pf_snprintf_compiled(buf, sizeof(buf), compiled, 6, 3, 7, 4, "ab");
+            sprintf(buf_std, "|%*.*d|%-*s|", 6, 3, 7, 4, "ab");
+            expect_str(buf, buf_std);
+
+            pf_free_compiled_format(compiled);
+        }
+
+        gp_test("Truncation and return value");
+        {
+            PFCompiledFormat* compiled = pf_compile_format("%s and more");
+            gp_assert(compiled != NULL);
+
+            int ret = pf_snprintf_compiled(buf, 6, compiled, "blah");
+            expect_str(buf, "blah ");
+            gp_expect(ret == (int)strlen("blah and more"), (ret));
+
+            pf_free_compiled_format(compiled);
+        }
+    } // gp_suite("Compiled formats");
+
+    gp_suite("Format cache");
+    {
+        gp_test("Same output as uncached");
+        {
+            const char* format = "blah %-8i|%+.*f|%#x %s%% %c";
+            pf_snprintf(buf_std, sizeof(buf_std), format,
+                -12, 3, 3.14159, 0xbee, "bloink", 'x');
+
+            pf_format_cache_enable(true);
+            for (int i = 0; i < 2; i++) // miss, then hit
+            {
+                pf_snprintf(buf, sizeof(buf), format,
+                    -12, 3, 3.14159, 0xbee, "bloink", 'x');
+                expect_str(buf, buf_std);
+            }
+            pf_format_cache_enable(false);
+
+            PFFormatCacheStats stats = pf_format_cache_stats();
+            gp_expect(stats.hits == 1, (stats.hits));
+        }
+    } // gp_suite("Format cache");
+
+    gp_suite("Type-safe formatting");
+    {
+        gp_test("Default conversions");
+        {
+            int ret = pf_format(buf, sizeof(buf),
+                "int ", -3, ", unsigned ", 7u, ", double ", 1.5,
+                ", char ", (char)'x', ", string ", (const char*)"str");
+            expect_str(buf, "int -3, unsigned 7, double 1.5, char x, string str");
+            gp_expect(ret == (int)strlen(buf), (ret));
+
+            void* p = (void*)0xbeef;
+            pf_format(buf, sizeof(buf), p);
+            sprintf(buf_std, "%p", p);
+            expect_str(buf, buf_std);
+        }
+
+        gp_test("Explicit specifiers");
+        {
+            for (int i = 0; i < 2; i++) // specifiers scanned on first iteration only
+            {
+                pf_format(buf, sizeof(buf),
+                    PF_SPEC("%08.3f", 3.14159), "|", PF_SPEC("%#x", 255),
+                    "|", PF_SPEC("%-5s", "ab"), "|", PF_SPEC("%+d", 5l));
+                sprintf(buf_std, "%08.3f|%#x|%-5s|%+d", 3.14159, 255, "ab", 5);
+                expect_str(buf, buf_std);
+            }
+        }
+
+        gp_test("Floats");
+        {
+            pf_format(buf, sizeof(buf),
+                0.1f, "|", PF_SPEC("%.10f", 0.1f), "|", PF_SPEC("%r", 0.1f));
+            expect_str(buf, "0.1|0.1000000015|0.1");
+        }
+
+        gp_test("Long doubles");
+        {
+            pf_format(buf, sizeof(buf),
+                0.5L, "|", PF_SPEC("%.3Le", 0x1p70L), "|", PF_SPEC("%.2f", 2.5L));
+            expect_str(buf, "0.5|1.181e+21|2.50");
+        }
+
+        gp_test("Mismatched conversion falls back to default");
+        {
+            pf_format(buf, sizeof(buf), PF_SPEC("%5s", 42));
+            expect_str(buf, "   42");
+        }
+
+        gp_test("Truncation");
+        {
+            int ret = pf_format(buf, 4, "blah", 123);
+            expect_str(buf, "bla");
+            gp_expect(ret == 7, (ret));
+        }
+    } // gp_suite("Type-safe formatting");
+
+    gp_suite("Sink");
+    {
+        static struct Output output;
+        char chunk[PF_SINK_MIN_CAPACITY];
+        PFSink sink = { write_output, &output, chunk, sizeof chunk };
+
+        gp_test("Output is streamed in chunks");
+        {
+            output = (struct Output){};
+            const char* format = "blah %-8i|%+.3f|%#x %s%% %c|%.20e|%lu blah";
+            int ret = pf_sinkprintf(&sink, format,
+                -12, 3.14159, 0xbee, "bloink", 'x', 1e-300, 1234567890123lu);
+            int ret_std = sprintf(buf_std, format,
+                -12, 3.14159, 0xbee, "bloink", 'x', 1e-300, 1234567890123lu);
+            output.data[output.length] = '\0';
+            expect_str(output.data, buf_std);
+            gp_expect(ret == ret_std, (ret), (ret_std));
+            gp_expect(output.writes > 1, (output.writes));
+        }
+
+        gp_test("Fields and precisions larger than chunk");
+        {
+            const char* format =
+                "%0*d|%*s|%+0*.3f|% 0*e|%#0*x|%*c|%-*u|%*.*i|%.*f|%0*f";
+            const int w = 2 * PF_SINK_MIN_CAPACITY;
+            #define SINK_TEST_ARGS \
+                w, -12, w, "blah", w, 3.14159, w, 2.5, w, 0xbee, w, 'x', \
+                w, 7u, w, w, 5, 1500, 1e300, w, -HUGE_VAL
+            output = (struct Output){};
+            int ret = pf_sinkprintf(&sink, format, SINK_TEST_ARGS);
+            char expected[sizeof output.data];
+            int ret_std = sprintf(expected, format, SINK_TEST_ARGS);
+            #undef SINK_TEST_ARGS
+            output.data[output.length] = '\0';
+            expect_str(output.data, expected);
+            gp_expect(ret == ret_std, (ret), (ret_std));
+        }
+
+        gp_test("pf_fprintf() output larger than its buffer");
+        {
+            FILE* f = tmpfile();
+            gp_assert(f != NULL);
+            int ret = pf_fprintf(f, "%s|%5000.3f|%d", "start", 1.5, 42);
+            char expected[sizeof output.data];
+            sprintf(expected, "%s|%5000.3f|%d", "start", 1.5, 42);
+            gp_expect(ret == (int)strlen(expected), (ret));
+
+            char result[sizeof output.data] = "";
+            rewind(f);
+            size_t read = fread(result, 1, sizeof result - 1, f);
+            gp_expect(read == strlen(expected), (read));
+            expect_str(result, expected);
+            fclose(f);
+        }
+    } // gp_suite("Sink");
+
+    gp_suite("Arrays");
+    {
+        const uint64_t u[] = { 0, 1, 42, 1234567890123, UINT64_MAX };
+        const int64_t  i[] = { -1, 0, 7, INT64_MIN, INT64_MAX };
+        const double   f[] = { 0., -1.5, 3.14159, 1e300, -HUGE_VAL };
+        char expected[512];
+
+        gp_test("Default formats");
+        {
+            size_t ret = pf_utoa_array(buf, sizeof buf, u, 5, ",", NULL);
+            sprintf(expected, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+                u[0], u[1], u[2], u[3], u[4]);
+            expect_str(buf, expected);
+            gp_expect(ret == strlen(expected), (ret));
+
+            ret = pf_itoa_array(buf, sizeof buf, i, 5, ", ", NULL);
+            sprintf(expected, "%" PRId64 ", %" PRId64 ", %" PRId64 ", %" PRId64 ", %" PRId64,
+                i[0], i[1], i[2], i[3], i[4]);
+            expect_str(buf, expected);
+
+            ret = pf_ftoa_array(buf, sizeof buf, f, 5, "; ", NULL);
+            sprintf(expected, "%f; %f; %f; %f; %f", f[0], f[1], f[2], f[3], f[4]);
+            expect_str(buf, expected);
+
+            ret = pf_utoa_array(buf, sizeof buf, u, 0, ",", NULL);
+            expect_str(buf, "");
+            gp_expect(ret == 0, (ret));
+        }
+
+        gp_test("Element formats");
+        {
+            PFFormatSpecifier fmt = pf_scan_format_string("%#018lx", NULL);
+            pf_utoa_array(buf, sizeof buf, u, 3, " ", &fmt);
+            sprintf(expected, "%#018lx %#018lx %#018lx",
+                (unsigned long)u[0], (unsigned long)u[1], (unsigned long)u[2]);
+            expect_str(buf, expected);
+
+            fmt = pf_scan_format_string("%+06d", NULL);
+            pf_itoa_array(buf, sizeof buf, i, 3, "|", &fmt);
+            sprintf(expected, "%+06d|%+06d|%+06d", (int)i[0], (int)i[1], (int)i[2]);
+            expect_str(buf, expected);
+
+            fmt = pf_scan_format_string("%-12.3e", NULL);
+            pf_ftoa_array(buf, sizeof buf, f, 5, "|", &fmt);
+            sprintf(expected, "%-12.3e|%-12.3e|%-12.3e|%-12.3e|%-12.3e",
+                f[0], f[1], f[2], f[3], f[4]);
+            expect_str(buf, expected);
+
+            // Mismatched conversion falls back to default
+            fmt = pf_scan_format_string("%8s", NULL);
+            pf_ftoa_array(buf, sizeof buf, f, 2, "", &fmt);
+            sprintf(expected, "%8f%8f", f[0], f[1]);
+            expect_str(buf, expected);
+        }
+
+        gp_test("Truncation");
+        {
+            size_t ret = pf_utoa_array(buf, 8, u, 5, ",", NULL);
+            expect_str(buf, "0,1,42,");
+            gp_expect(ret == strlen("0,1,42,1234567890123,18446744073709551615"),
+                (ret));
+        }
+
+        gp_test("Sink");
+        {
+            static struct Output output;
+            char chunk[PF_SINK_MIN_CAPACITY];
+            PFSink sink = { write_output, &output, chunk, sizeof chunk };
+
+            uint64_t many[400];
+            char big_expected[sizeof output.data];
+            char* p = big_expected;
+            for (size_t j = 0; j < 400; j++)
+            {
+                many[j] = j * 0x9e3779b97f4a7c15u;
+                p += sprintf(p, j ? " %016" PRIx64 : "%016" PRIx64, many[j]);
+            }
+            const PFFormatSpecifier fmt = pf_scan_format_string("%016lx", NULL);
+            size_t ret = pf_utoa_array_sink(&sink, many, 400, " ", &fmt);
+            output.data[output.length] = '\0';
+            expect_str(output.data, big_expected);
+            gp_expect(ret == strlen(big_expected), (ret));
+        }
+    } // gp_suite("Arrays");
+
+    gp_suite("Allocating");
+    {
+        gp_test("Small and large outputs");
+        {
+            const int widths[] = { 0, 300, 5000, 1 << 20 };
+            for (size_t i = 0; i < sizeof widths / sizeof widths[0]; i++)
+            {
+                char* result;
+                char* result_shrunk;
+                char* expected;
+                int ret = pf_asprintf(
+                    &result, "%s %*d|%.3f", "blah", widths[i], -3, 1.5);
+                int ret_shrunk = pf_asprintf_shrink(
+                    &result_shrunk, "%s %*d|%.3f", "blah", widths[i], -3, 1.5);
+                int ret_std = snprintf(
+                    NULL, 0, "%s %*d|%.3f", "blah", widths[i], -3, 1.5);
+                expected = malloc(ret_std + 1);
+                sprintf(expected, "%s %*d|%.3f", "blah", widths[i], -3, 1.5);
+                gp_assert(result != NULL && result_shrunk != NULL);
+
+                gp_expect(ret == ret_std, (ret), (ret_std));
+                gp_expect(ret_shrunk == ret_std, (ret_shrunk), (ret_std));
+                gp_expect(strcmp(result, expected) == 0, (widths[i]));
+                gp_expect(strcmp(result_shrunk, expected) == 0, (widths[i]));
+
+                free(result);
+                free(result_shrunk);
+                free(expected);
+            }
+        }
+    } // gp_suite("Allocating");
+
+    gp_suite("File streams");
+    {
+        gp_test("Mixed with stdio in all buffering modes");
+        {
+            const int modes[] = { _IOFBF, _IOLBF, _IONBF };
+            for (size_t i = 0; i < sizeof modes / sizeof modes[0]; i++)
+            {
+                FILE* f = tmpfile();
+                gp_assert(f != NULL);
+                gp_assert(setvbuf(f, NULL, modes[i], BUFSIZ) == 0);
+
+                static char expected[1 << 16];
+                static char result[1 << 16];
+                size_t expected_length = 0;
+                for (int j = 0; j < 100; j++)
+                {
+                    // Some lines are longer than the stream buffer
+                    const int width = j % 10 == 0 ? 5000 : j;
+                    fputs("std ", f);
+                    int ret = pf_fprintf(f, "%i %*s|%.3f\n", j, width, "x", j * .5);
+                    int ret_std = sprintf(expected + expected_length,
+                        "std %i %*s|%.3f\n", j, width, "x", j * .5);
+                    gp_expect(ret == ret_std - (int)strlen("std "), (ret), (j));
+                    expected_length += ret_std;
+                }
+
+                rewind(f);
+                size_t read = fread(result, 1, sizeof result - 1, f);
+                result[read] = '\0';
+                gp_expect(read == expected_length, (read), (modes[i]));
+                expect_str(result, expected);
+                fclose(f);
+            }
+        }
+
+        gp_test("Compiled format");
+        {
+            FILE* f = tmpfile();
+            gp_assert(f != NULL);
+            PFCompiledFormat* compiled = pf_compile_format("%s %d|");
+            gp_assert(compiled != NULL);
+
+            for (int i = 0; i < 3; i++)
+                pf_fprintf_compiled(f, compiled, "blah", i);
+
+            char result[64] = "";
+            rewind(f);
+            gp_assert(fread(result, 1, sizeof result - 1, f) > 0);
+            expect_str(result, "blah 0|blah 1|blah 2|");
+
+            pf_free_compiled_format(compiled);
+            fclose(f);
+        }
+    } // gp_suite("File streams");
+
+    #if defined(__unix__) || defined(__APPLE__)
+    gp_suite("File descriptors");
+    {
+        int fds[2];
+        gp_assert(pipe(fds) == 0);
+        static char result[1 << 16];
+        static char expected[1 << 16];
+
+        gp_test("pf_dprintf()");
+        {
+            int ret = pf_dprintf(fds[1], "%s|%6000.3f|%d", "start", 1.5, 42);
+            int ret_std = sprintf(expected, "%s|%6000.3f|%d", "start", 1.5, 42);
+            gp_expect(ret == ret_std, (ret), (ret_std));
+
+            ssize_t total = 0;
+            while (total < ret_std)
+                total += read(fds[0], result + total, sizeof result - 1 - total);
+            result[total] = '\0';
+            expect_str(result, expected);
+        }
+
+        gp_test("Batch written only when flushed");
+        {
+            PFBatch batch = { .fd = fds[1] };
+            size_t expected_length = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                pf_batch_printf(&batch, "record %i|", i);
+                expected_length += sprintf(
+                    expected + expected_length, "record %i|", i);
+            }
+            gp_expect(batch.count == 3, (batch.count));
+
+            gp_assert(pf_batch_flush(&batch) == 0);
+            gp_expect(batch.count == 0, (batch.count));
+            ssize_t got = read(fds[0], result, sizeof result - 1);
+            gp_assert(got == (ssize_t)expected_length, (got));
+            result[got] = '\0';
+            expect_str(result, expected);
+        }
+
+        gp_test("Batch overflow");
+        {
+            PFBatch batch = { .fd = fds[1] };
+            size_t expected_length = 0;
+            for (int i = 0; i < 2 * PF_BATCH_MAX_RECORDS; i++)
+            {
+                // Some records are longer than batch buffer
+                const int width = i % 32 == 0 ? PF_BATCH_BUFFER_SIZE + 100 : 20;
+                int ret = pf_batch_printf(&batch, "%*i|", width, i);
+                int ret_std = sprintf(
+                    expected + expected_length, "%*i|", width, i);
+                gp_expect(ret == ret_std, (ret), (ret_std));
+                expected_length += ret_std;
+            }
+            gp_assert(pf_batch_flush(&batch) == 0);
+
+            size_t total = 0;
+            while (total < expected_length)
+                total += read(fds[0], result + total, sizeof result - 1 - total);
+            result[total] = '\0';
+            expect_str(result, expected);
+        }
+
+        gp_test("Write errors");
+        {
+            gp_expect(pf_dprintf(-1, "%s|%6000.3f", "start", 1.5) == -1);
+
+            PFBatch batch = { .fd = -1 };
+            gp_expect(pf_batch_printf(&batch, "%i", 1) == 1);
+            gp_expect(pf_batch_printf(
+                &batch, "%*i", PF_BATCH_BUFFER_SIZE + 100, 2) == -1);
+            gp_expect(pf_batch_printf(&batch, "%i", 3) == 1);
+            gp_expect(pf_batch_flush(&batch) == -1);
+            gp_expect(batch.count == 0, (batch.count));
+        }
+
+        close(fds[0]);
+        close(fds[1]);
+    } // gp_suite("File descriptors");
+    #endif
+
     gp_suite("Fuzz test");
     {
         // Seed RNG with date
@@ -272,6 +828,7 @@ int main(void)
         }
         const unsigned loop_count = FUZZ_COUNT;
         const char* random_format(char conversion_type);
+        bool coin_flip();
 
         gp_test("Random formats with random values");
         {
@@ -403,6 +960,100 @@ int main(void)
                     (iteration));
             }
         }
+
+        gp_test("Moderate doubles with low precision");
+        {
+            for (unsigned iteration = 1; iteration <= loop_count; iteration++)
+            {
+                const uint64_t mantissa =
+                    (uint64_t)pcg32_random() << 32 | pcg32_random();
+                const uint64_t exponent = 1003 + pcg32_boundedrand(70);
+                union { uint64_t u; double f; } punner = {
+                    .u = (mantissa & ((1ull << 52) - 1)) | exponent << 52 };
+                const char* conversions = "fFeEgG";
+                const char conversion =
+                    conversions[pcg32_boundedrand(strlen(conversions))];
+                const int precision = pcg32_boundedrand(19);
+
+                char fmt[8] = "%.*f";
+                fmt[3] = conversion;
+                pf_snprintf(buf, sizeof buf, fmt, precision, punner.f);
+                snprintf(buf_std, sizeof buf_std, fmt, precision, punner.f);
+
+                const char* _my_buf = buf;
+                gp_assert(strcmp(buf, buf_std) == 0,
+                    (fmt),
+                    (precision),
+                    ("%a", punner.f),
+                    (_my_buf),
+                    (buf_std),
+                    (iteration));
+            }
+        }
+
+        gp_test("Formatted length");
+        {
+            for (unsigned iteration = 1; iteration <= loop_count; iteration++)
+            {
+                const char* all_specs = "diouxXeEfFgGcsp";
+                const char random_specifier =
+                    all_specs[pcg32_boundedrand(strlen(all_specs))];
+
+                // Replace length modifier with 'j' to pass intmax_t
+                char fmt[64];
+                const char* random_fmt = random_format(random_specifier);
+                size_t fmt_length = strcspn(random_fmt, "hlzt");
+                memcpy(fmt, random_fmt, fmt_length);
+                if (strchr("diouxX", random_specifier))
+                    fmt[fmt_length++] = 'j';
+                fmt[fmt_length++] = random_specifier;
+                fmt[fmt_length]   = '\0';
+
+                const uintmax_t u =
+                    (uintmax_t)pcg32_random() << 32 | pcg32_random();
+                int length   = 0;
+                int expected = 0;
+                if (strchr("eEfFgG", random_specifier))
+                {
+                    // Random bits or values that round to powers of ten
+                    union { uint64_t u; double f; } punner = { .u = u };
+                    double f = punner.f;
+                    if (coin_flip())
+                    {
+                        const double roundings[] = { 1., .9999, .95, .99995 };
+                        f = roundings[pcg32_boundedrand(4)];
+                        for (int i = pcg32_boundedrand(110); i > 0; i--)
+                            f *= coin_flip() ? 10 : .1;
+                    }
+                    length   = pf_formatted_length(fmt, f);
+                    expected = pf_snprintf(NULL, 0, fmt, f);
+                }
+                else if (random_specifier == 's')
+                {
+                    length   = pf_formatted_length(fmt, "blah blah");
+                    expected = pf_snprintf(NULL, 0, fmt, "blah blah");
+                }
+                else if (random_specifier == 'c')
+                {
+                    length   = pf_formatted_length(fmt, (char)u);
+                    expected = pf_snprintf(NULL, 0, fmt, (char)u);
+                }
+                else if (random_specifier == 'p')
+                {
+                    length   = pf_formatted_length(fmt, (void*)(uintptr_t)u);
+                    expected = pf_snprintf(NULL, 0, fmt, (void*)(uintptr_t)u);
+                }
+                else
+                {
+                    const uintmax_t x = u >> pcg32_boundedrand(64);
+                    length   = pf_formatted_length(fmt, x);
+                    expected = pf_snprintf(NULL, 0, fmt, x);
+                }
+
+                gp_assert(length == expected,
+                    (fmt), ("%#jx", u), (length), (expected), (iteration));
+            }
+        }
     }
 
     // -------- INTERNAL ----------------- //